@@ -0,0 +1,331 @@
+//
+//  DMXartnetTransport.h
+//  ofxOlaShaderLight
+//
+//  Sends universes as Art-Net straight to the nodes that want them,
+//  without olad. Independent of openFrameworks.
+//
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include "DMXoutput.h"
+#include "DMXudp.h"
+
+// Finds the nodes on the network with an ArtPoll broadcast every few
+// seconds and keeps a table of which nodes output which Port-Address, from
+// their ArtPollReplies. Each universe's ArtDmx packet is then unicast to
+// just those nodes, rather than broadcast to every node on the network.
+// Nodes that stop replying drop out of the table.
+// Packets are built once per universe and reused, a frame only writes the
+// sequence number and the slots, and the frame goes out in one batch.
+
+class DMXartnetTransport : public DMXtransport
+{
+public:
+
+    static const unsigned short port = 6454;
+
+    // polls are broadcast to broadcastAddress; replies come back to
+    // listenPort, which nodes expect to be the Art-Net port
+    DMXartnetTransport(std::string broadcastAddress = "255.255.255.255", unsigned short listenPort = port, unsigned short destinationPort = port)
+    {
+        this->broadcastAddress = broadcastAddress;
+        this->listenPort = listenPort;
+        this->destinationPort = destinationPort;
+        universeOffset = 0;
+        pollMillis = 3000;
+        lastPoll = 0;
+        tableChanged = false;
+        buildPollPacket();
+    };
+
+    bool setup()
+    {
+        if(!DMXudpSocket::address(broadcastAddress, destinationPort, pollDestination))
+        {
+            std::cerr << "Art-Net: " << broadcastAddress << " is not an IPv4 address" << std::endl;
+            return false;
+        }
+        if(!udp.open(listenPort, true))
+        {
+            std::cerr << "Art-Net socket failed, is port " << listenPort << " in use?" << std::endl;
+            return false;
+        }
+        poll();
+        return true;
+    };
+
+    // Port-Address = engine universe + offset
+    void setUniverseOffset(unsigned int offset)
+    {
+        universeOffset = offset;
+        packets.clear();
+    };
+
+    // how often nodes are polled, a node is dropped after three polls
+    // without a reply
+    void setPollInterval(unsigned int millis)
+    {
+        pollMillis = millis;
+    };
+
+    // nodes that output at least one Port-Address
+    size_t getNodeCount()
+    {
+        return nodes.size();
+    };
+
+    // how many nodes a universe is sent to
+    size_t getSubscriberCount(unsigned int number)
+    {
+        std::map<unsigned short, std::vector<unsigned int> >::iterator it = subscribers.find(portAddress(number));
+        return it != subscribers.end() ? it->second.size() : 0;
+    };
+
+    void sendUniverse(unsigned int number, const unsigned char * slots, const unsigned char * /* previous */)
+    {
+        if(!udp.isOpen())
+        {
+            return;
+        }
+        unsigned short address = portAddress(number);
+        std::map<unsigned short, Packet>::iterator it = packets.find(address);
+        if(it == packets.end())
+        {
+            it = packets.insert(std::make_pair(address, Packet())).first;
+            buildDmxPacket(it->second, address);
+            it->second.destinations = destinationsFor(address);
+        }
+        Packet & p = it->second;
+        if(p.destinations.empty())
+        {
+            // no node outputs this universe
+            return;
+        }
+        p.sequence = p.sequence == 255 ? 1 : p.sequence + 1;
+        p.data[SEQUENCE] = p.sequence;
+        memcpy(p.data + SLOTS, slots, MAX_DMX_CHANNELS);
+        for(size_t i = 0; i < p.destinations.size(); i++)
+        {
+            udp.queue(p.data, DMX_PACKET_SIZE, p.destinations[i]);
+        }
+    };
+
+    // sends the frame, then takes in replies and polls. The routing table
+    // only changes here, after sending, as queued packets point into it.
+    void flush()
+    {
+        if(udp.queued() > 0 && !udp.send())
+        {
+            std::cerr << "Art-Net send failed" << std::endl;
+        }
+        receiveReplies();
+        unsigned long long now = DMXmicros() / 1000;
+        if(now - lastPoll >= pollMillis)
+        {
+            expireNodes(now);
+            poll();
+        }
+        if(tableChanged)
+        {
+            rebuildRoutes();
+        }
+    };
+
+protected:
+
+    enum {
+        OP_POLL = 0x2000,
+        OP_POLL_REPLY = 0x2100,
+        OP_DMX = 0x5000,
+        PROTOCOL_VERSION = 14,
+        POLL_PACKET_SIZE = 14,
+        DMX_PACKET_SIZE = 18 + MAX_DMX_CHANNELS,
+        POLL_REPLY_MIN_SIZE = 194,
+        SEQUENCE = 12,
+        SLOTS = 18,
+        PORT_OUTPUTS_DMX = 0x80
+    };
+
+    struct Packet
+    {
+        Packet() : sequence(0) {};
+        unsigned char sequence;
+        std::vector<sockaddr_in> destinations;
+        unsigned char data[DMX_PACKET_SIZE];
+    };
+
+    struct Node
+    {
+        sockaddr_in address;
+        unsigned long long lastSeen;
+        // per BindIndex, a node with more than four ports replies once
+        // for every four
+        std::map<unsigned char, std::vector<unsigned short> > portAddresses;
+    };
+
+    unsigned short portAddress(unsigned int number)
+    {
+        return (number + universeOffset) & 0x7fff;
+    };
+
+    static void writeHeader(unsigned char * packet, unsigned short opCode)
+    {
+        memcpy(packet, "Art-Net\0", 8);
+        packet[8] = opCode & 0xff;
+        packet[9] = opCode >> 8;
+    };
+
+    void buildPollPacket()
+    {
+        memset(pollPacket, 0, POLL_PACKET_SIZE);
+        writeHeader(pollPacket, OP_POLL);
+        pollPacket[10] = 0;
+        pollPacket[11] = PROTOCOL_VERSION;
+        // reply whenever node conditions change, not only when polled
+        pollPacket[12] = 0x02;
+    };
+
+    void buildDmxPacket(Packet & p, unsigned short address)
+    {
+        unsigned char * d = p.data;
+        memset(d, 0, DMX_PACKET_SIZE);
+        writeHeader(d, OP_DMX);
+        d[10] = 0;
+        d[11] = PROTOCOL_VERSION;
+        d[13] = 0;
+        d[14] = address & 0xff;
+        d[15] = address >> 8;
+        d[16] = MAX_DMX_CHANNELS >> 8;
+        d[17] = MAX_DMX_CHANNELS & 0xff;
+    };
+
+    void poll()
+    {
+        udp.queue(pollPacket, POLL_PACKET_SIZE, pollDestination);
+        udp.send();
+        lastPoll = DMXmicros() / 1000;
+    };
+
+    void receiveReplies()
+    {
+        sockaddr_in from;
+        int size;
+        while((size = udp.receive(reply, sizeof(reply), from)) >= 0)
+        {
+            if(size < POLL_REPLY_MIN_SIZE || memcmp(reply, "Art-Net\0", 8) != 0 || (reply[8] | (reply[9] << 8)) != OP_POLL_REPLY)
+            {
+                continue;
+            }
+            // the node's own address, it may answer from another
+            unsigned int ip = (reply[10] << 24) | (reply[11] << 16) | (reply[12] << 8) | reply[13];
+            Node & node = nodes[ip];
+            memset(&node.address, 0, sizeof(node.address));
+            node.address.sin_family = AF_INET;
+            node.address.sin_addr.s_addr = htonl(ip);
+            node.address.sin_port = htons(destinationPort);
+            node.lastSeen = DMXmicros() / 1000;
+
+            unsigned char net = reply[18] & 0x7f;
+            unsigned char sub = reply[19] & 0x0f;
+            unsigned int numPorts = std::min(reply[173], (unsigned char) 4);
+            // bind index 0 from nodes older than Art-Net 3
+            unsigned char bindIndex = size > 211 ? reply[211] : 0;
+            std::vector<unsigned short> outputs;
+            for(unsigned int i = 0; i < numPorts; i++)
+            {
+                if(reply[174+i] & PORT_OUTPUTS_DMX)
+                {
+                    outputs.push_back((net << 8) | (sub << 4) | (reply[190+i] & 0x0f));
+                }
+            }
+            if(node.portAddresses[bindIndex] != outputs)
+            {
+                node.portAddresses[bindIndex] = outputs;
+                tableChanged = true;
+            }
+        }
+    };
+
+    void expireNodes(unsigned long long now)
+    {
+        for(std::map<unsigned int, Node>::iterator it = nodes.begin(); it != nodes.end();)
+        {
+            if(now - it->second.lastSeen > 3 * pollMillis)
+            {
+                nodes.erase(it++);
+                tableChanged = true;
+            }
+            else
+            {
+                it++;
+            }
+        }
+    };
+
+    // works out which nodes every Port-Address goes to
+    void rebuildRoutes()
+    {
+        subscribers.clear();
+        for(std::map<unsigned int, Node>::iterator it = nodes.begin(); it != nodes.end(); it++)
+        {
+            std::map<unsigned char, std::vector<unsigned short> > & bound = it->second.portAddresses;
+            for(std::map<unsigned char, std::vector<unsigned short> >::iterator b = bound.begin(); b != bound.end(); b++)
+            {
+                for(size_t i = 0; i < b->second.size(); i++)
+                {
+                    std::vector<unsigned int> & ips = subscribers[b->second[i]];
+                    if(std::find(ips.begin(), ips.end(), it->first) == ips.end())
+                    {
+                        ips.push_back(it->first);
+                    }
+                }
+            }
+        }
+        for(std::map<unsigned short, Packet>::iterator it = packets.begin(); it != packets.end(); it++)
+        {
+            it->second.destinations = destinationsFor(it->first);
+        }
+        tableChanged = false;
+    };
+
+    std::vector<sockaddr_in> destinationsFor(unsigned short address)
+    {
+        std::vector<sockaddr_in> destinations;
+        std::map<unsigned short, std::vector<unsigned int> >::iterator it = subscribers.find(address);
+        if(it != subscribers.end())
+        {
+            for(size_t i = 0; i < it->second.size(); i++)
+            {
+                destinations.push_back(nodes[it->second[i]].address);
+            }
+        }
+        return destinations;
+    };
+
+    std::string broadcastAddress;
+    unsigned short listenPort;
+    unsigned short destinationPort;
+    unsigned int universeOffset;
+    DMXudpSocket udp;
+
+    unsigned int pollMillis;
+    unsigned long long lastPoll;
+    unsigned char pollPacket[POLL_PACKET_SIZE];
+    sockaddr_in pollDestination;
+    unsigned char reply[1024];
+
+    // by IP address, host order
+    std::map<unsigned int, Node> nodes;
+    std::map<unsigned short, std::vector<unsigned int> > subscribers;
+    bool tableChanged;
+
+    std::map<unsigned short, Packet> packets;
+
+};
@@ -0,0 +1,210 @@
+//
+//  DMXasyncTransport.h
+//  ofxOlaShaderLight
+//
+//  Hands universes to another transport on a thread of its own, so a slow
+//  receiver never holds up the sender. Independent of openFrameworks.
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cstring>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "DMXoutput.h"
+
+// Wraps a transport whose sends can block, like the OLA StreamingClient
+// when olad is slow to read its socket. sendUniverse() only copies the
+// slots into a per-universe slot and returns; flush() wakes the thread,
+// which passes everything waiting on to the wrapped transport as one
+// frame. A universe holds one frame at most: a newer frame replaces one
+// the thread hasn't got to, and counts as dropped. The wrapped transport
+// is only ever called from the thread, after setup().
+
+class DMXasyncTransport : public DMXtransport
+{
+public:
+
+    // transport stays the app's and must outlive this
+    DMXasyncTransport(DMXtransport * transport)
+    {
+        this->transport = transport;
+        running = false;
+        flushed = false;
+        timecodeWaiting = false;
+        dropped = 0;
+    };
+
+    ~DMXasyncTransport()
+    {
+        stopThread();
+    };
+
+    bool setup()
+    {
+        stopThread();
+        if(!transport->setup())
+        {
+            return false;
+        }
+        running = true;
+        thread = std::thread(&DMXasyncTransport::threadedFunction, this);
+        return true;
+    };
+
+    void sendUniverse(unsigned int number, const unsigned char * slots, const unsigned char * previous)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Waiting & w = waiting[number];
+        if(w.waiting)
+        {
+            w.dropped++;
+            dropped++;
+        }
+        memcpy(w.slots, slots, MAX_DMX_CHANNELS);
+        w.waiting = true;
+        // a keep-alive or first send stays complete if it is replaced
+        w.complete |= previous == NULL;
+    };
+
+    void flush()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            flushed = true;
+        }
+        wake.notify_one();
+    };
+
+    void sendTimecode(const DMXtimecode & timecode)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->timecode = timecode;
+        timecodeWaiting = true;
+    };
+
+    // universe frames replaced before they were sent
+    unsigned long long getDroppedFrames()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return dropped;
+    };
+
+    unsigned long long getDroppedFrames(unsigned int number)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::map<unsigned int, Waiting>::iterator it = waiting.find(number);
+        return it != waiting.end() ? it->second.dropped : 0;
+    };
+
+    DMXtransport * getTransport()
+    {
+        return transport;
+    };
+
+protected:
+
+    struct Waiting
+    {
+        Waiting() : waiting(false), complete(false), dropped(0) {};
+        bool waiting;
+        bool complete;
+        unsigned long long dropped;
+        unsigned char slots[MAX_DMX_CHANNELS];
+    };
+
+    // the thread's own copy of a universe, and what it last sent of it
+    struct Outgoing
+    {
+        Outgoing() : sent(false), complete(false) {};
+        bool sent;
+        bool complete;
+        unsigned char slots[MAX_DMX_CHANNELS];
+        unsigned char previous[MAX_DMX_CHANNELS];
+    };
+
+    void stopThread()
+    {
+        if(!thread.joinable())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            running = false;
+        }
+        wake.notify_one();
+        thread.join();
+    };
+
+    void threadedFunction()
+    {
+        std::vector<unsigned int> batch;
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true)
+        {
+            wake.wait(lock, [this]{ return !running || flushed; });
+            if(!running)
+            {
+                return;
+            }
+            flushed = false;
+            bool sendTimecode = timecodeWaiting;
+            DMXtimecode tc = timecode;
+            timecodeWaiting = false;
+            // take the waiting universes, the app can queue new ones
+            // while they are sent
+            batch.clear();
+            for(std::map<unsigned int, Waiting>::iterator it = waiting.begin(); it != waiting.end(); it++)
+            {
+                Waiting & w = it->second;
+                if(w.waiting)
+                {
+                    Outgoing & o = outgoing[it->first];
+                    memcpy(o.slots, w.slots, MAX_DMX_CHANNELS);
+                    o.complete = w.complete;
+                    w.waiting = false;
+                    w.complete = false;
+                    batch.push_back(it->first);
+                }
+            }
+            lock.unlock();
+
+            if(sendTimecode)
+            {
+                transport->sendTimecode(tc);
+            }
+            for(size_t i = 0; i < batch.size(); i++)
+            {
+                Outgoing & o = outgoing[batch[i]];
+                transport->sendUniverse(batch[i], o.slots, (o.sent && !o.complete) ? o.previous : NULL);
+                memcpy(o.previous, o.slots, MAX_DMX_CHANNELS);
+                o.sent = true;
+            }
+            transport->flush();
+
+            lock.lock();
+        }
+    };
+
+    DMXtransport * transport;
+
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool running;
+    bool flushed;
+
+    // guarded by mutex
+    std::map<unsigned int, Waiting> waiting;
+    DMXtimecode timecode;
+    bool timecodeWaiting;
+    unsigned long long dropped;
+
+    // the thread's alone
+    std::map<unsigned int, Outgoing> outgoing;
+
+};
@@ -0,0 +1,276 @@
+//
+//  DMXclock.h
+//  ofxOlaShaderLight
+//
+//  Timecode and the show clock, independent of openFrameworks.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+
+#ifdef USE_OLA_LIB_AND_NOT_OSC
+#include <ola/timecode/TimeCode.h>
+#endif
+
+// Microseconds on the steady clock, the time base every fade is measured in
+// unless the engine follows a DMXclock.
+
+inline unsigned long long DMXmicros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// An hours:minutes:seconds:frames timecode. The types have the values of
+// ola::timecode::TimeCodeType.
+
+class DMXtimecode
+{
+public:
+
+    enum DMXtimecodeType
+    {
+        DMX_TIMECODE_FILM = 0,  // 24 fps
+        DMX_TIMECODE_EBU = 1,   // 25 fps
+        DMX_TIMECODE_DF = 2,    // 29.97 fps drop frame
+        DMX_TIMECODE_SMPTE = 3  // 30 fps
+    };
+
+    DMXtimecode(DMXtimecodeType type = DMX_TIMECODE_EBU, unsigned int hours = 0, unsigned int minutes = 0, unsigned int seconds = 0, unsigned int frames = 0)
+    {
+        this->type = type;
+        this->hours = hours;
+        this->minutes = minutes;
+        this->seconds = seconds;
+        this->frames = frames;
+    };
+
+#ifdef USE_OLA_LIB_AND_NOT_OSC
+    DMXtimecode(const ola::timecode::TimeCode & timecode)
+    {
+        type = (DMXtimecodeType) timecode.Type();
+        hours = timecode.Hours();
+        minutes = timecode.Minutes();
+        seconds = timecode.Seconds();
+        frames = timecode.Frames();
+    };
+
+    ola::timecode::TimeCode toOla() const
+    {
+        return ola::timecode::TimeCode((ola::timecode::TimeCodeType) type, hours, minutes, seconds, frames);
+    };
+#endif
+
+    // 30 for drop frame, which counts 30 frames a second but skips some
+    static unsigned int getNominalFramesPerSecond(DMXtimecodeType type)
+    {
+        switch(type)
+        {
+            case DMX_TIMECODE_FILM:
+                return 24;
+            case DMX_TIMECODE_EBU:
+                return 25;
+            default:
+                return 30;
+        }
+    };
+
+    static unsigned long long getFrameMicros(DMXtimecodeType type)
+    {
+        if(type == DMX_TIMECODE_DF)
+        {
+            return 1001000 / 30;
+        }
+        return 1000000 / getNominalFramesPerSecond(type);
+    };
+
+    // frames since 00:00:00:00
+    unsigned long long getFrameNumber() const
+    {
+        unsigned long long fps = getNominalFramesPerSecond(type);
+        unsigned long long frameNumber = ((hours * 60ull + minutes) * 60ull + seconds) * fps + frames;
+        if(type == DMX_TIMECODE_DF)
+        {
+            // frames 0 and 1 are skipped every minute but every tenth
+            unsigned long long totalMinutes = hours * 60ull + minutes;
+            frameNumber -= 2 * (totalMinutes - totalMinutes / 10);
+        }
+        return frameNumber;
+    };
+
+    // the first microsecond of the frame, rounded up so fromMicros() gives
+    // this frame back
+    unsigned long long toMicros() const
+    {
+        if(type == DMX_TIMECODE_DF)
+        {
+            return (getFrameNumber() * 1001000000ull + 29999) / 30000;
+        }
+        unsigned long long fps = getNominalFramesPerSecond(type);
+        return (getFrameNumber() * 1000000ull + fps - 1) / fps;
+    };
+
+    // the frame micros falls in, hours wrap at 24
+    static DMXtimecode fromMicros(unsigned long long micros, DMXtimecodeType type)
+    {
+        unsigned long long fps = getNominalFramesPerSecond(type);
+        unsigned long long frameNumber;
+        if(type == DMX_TIMECODE_DF)
+        {
+            frameNumber = micros * 30000 / 1001000000ull;
+            // put the skipped frame numbers back in
+            unsigned long long tenMinutes = frameNumber / 17982;
+            unsigned long long rest = frameNumber % 17982;
+            frameNumber += 18 * tenMinutes + (rest >= 2 ? 2 * ((rest - 2) / 1798) : 0);
+        }
+        else
+        {
+            frameNumber = micros * fps / 1000000ull;
+        }
+        return DMXtimecode(type, (frameNumber / (fps * 3600)) % 24, (frameNumber / (fps * 60)) % 60, (frameNumber / fps) % 60, frameNumber % fps);
+    };
+
+    DMXtimecodeType type;
+    unsigned int hours;
+    unsigned int minutes;
+    unsigned int seconds;
+    unsigned int frames;
+
+};
+
+// Show time in microseconds. It runs on the steady clock from wherever it
+// was started or located, or chases timecode: every timecode received
+// relocates it, unless it is already within the frame the timecode names,
+// and in between it freewheels. When no timecode arrives for the freewheel
+// time it holds.
+// Set from the app thread, read from any thread: the anchor is published
+// with a sequence lock, so readers never block.
+
+class DMXclock
+{
+public:
+
+    DMXclock()
+    {
+        sequence = 0;
+        anchorShow = 0;
+        anchorSteady = DMXmicros();
+        running = false;
+        chasing = false;
+        lastChase = 0;
+        freewheelMicros = 1000000;
+    };
+
+    void start()
+    {
+        if(!isRunning())
+        {
+            setAnchor(getMicros(), DMXmicros(), true);
+        }
+    };
+
+    void stop()
+    {
+        setAnchor(getMicros(), DMXmicros(), false);
+        chasing = false;
+    };
+
+    void locate(unsigned long long micros)
+    {
+        setAnchor(micros, DMXmicros(), isRunning());
+    };
+
+    void chase(const DMXtimecode & timecode)
+    {
+        unsigned long long received = timecode.toMicros();
+        unsigned long long predicted = getMicros();
+        unsigned long long now = DMXmicros();
+        bool wasRunning = isRunning() && !isHolding(now);
+        lastChase = now;
+        chasing = true;
+        if(!wasRunning || predicted < received || predicted >= received + DMXtimecode::getFrameMicros(timecode.type))
+        {
+            setAnchor(received, now, true);
+        }
+    };
+
+    // how long a chasing clock runs on without timecode
+    void setFreewheel(unsigned int millis)
+    {
+        freewheelMicros = millis * 1000ull;
+    };
+
+    bool isRunning() const
+    {
+        unsigned long long show, steady;
+        bool run;
+        getAnchor(show, steady, run);
+        return run;
+    };
+
+    unsigned long long getMicros() const
+    {
+        unsigned long long show, steady;
+        bool run;
+        getAnchor(show, steady, run);
+        if(!run)
+        {
+            return show;
+        }
+        unsigned long long now = DMXmicros();
+        if(isHolding(now))
+        {
+            now = lastChase + freewheelMicros;
+        }
+        return now > steady ? show + (now - steady) : show;
+    };
+
+    DMXtimecode getTimecode(DMXtimecode::DMXtimecodeType type) const
+    {
+        return DMXtimecode::fromMicros(getMicros(), type);
+    };
+
+protected:
+
+    bool isHolding(unsigned long long now) const
+    {
+        return chasing && now > lastChase + freewheelMicros;
+    };
+
+    void setAnchor(unsigned long long show, unsigned long long steady, bool run)
+    {
+        unsigned int s = sequence.load(std::memory_order_relaxed);
+        sequence.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        anchorShow.store(show, std::memory_order_relaxed);
+        anchorSteady.store(steady, std::memory_order_relaxed);
+        running.store(run, std::memory_order_relaxed);
+        sequence.store(s + 2, std::memory_order_release);
+    };
+
+    void getAnchor(unsigned long long & show, unsigned long long & steady, bool & run) const
+    {
+        unsigned int before, after;
+        do
+        {
+            before = sequence.load(std::memory_order_acquire);
+            show = anchorShow.load(std::memory_order_relaxed);
+            steady = anchorSteady.load(std::memory_order_relaxed);
+            run = running.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        }
+        while(before != after || (before & 1));
+    };
+
+    std::atomic<unsigned int> sequence;
+    std::atomic<unsigned long long> anchorShow;
+    std::atomic<unsigned long long> anchorSteady;
+    std::atomic<bool> running;
+
+    std::atomic<bool> chasing;
+    std::atomic<unsigned long long> lastChase;
+    std::atomic<unsigned long long> freewheelMicros;
+
+};
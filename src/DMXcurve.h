@@ -0,0 +1,106 @@
+//
+//  DMXcurve.h
+//  ofxOlaShaderLight
+//
+//  Response curves for DMX channels, independent of openFrameworks.
+//
+
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+// A response curve stored as a lookup table over the normalised channel
+// value. Curves are immutable and meant to be shared by pointer between
+// all channels that use them; a channel without a curve is linear.
+
+class DMXcurve
+{
+public:
+
+    static const int resolution = 4096;
+
+    // table holds at least two output values evenly spaced over 0..1,
+    // it is resampled to the curve's resolution
+    DMXcurve(const std::vector<float> & table)
+    {
+        lut.resize(resolution+1);
+        if(table.size() < 2)
+        {
+            for(int i = 0; i <= resolution; i++)
+            {
+                lut[i] = (float) i / resolution;
+            }
+            return;
+        }
+        float last = table.size()-1;
+        for(int i = 0; i <= resolution; i++)
+        {
+            float x = (float) i / resolution * last;
+            size_t index = (size_t) x;
+            size_t nextIndex = index < last ? index+1 : index;
+            float alpha = x - index;
+            lut[i] = table[index] + (table[nextIndex]-table[index])*alpha;
+        }
+    };
+
+    // v is clamped to 0..1
+    float apply(float v) const
+    {
+        v = v < 0. ? 0. : (v > 1. ? 1. : v);
+        float x = v * resolution;
+        int index = (int) x;
+        int nextIndex = index < resolution ? index+1 : index;
+        float alpha = x - index;
+        return lut[index] + (lut[nextIndex]-lut[index])*alpha;
+    };
+
+    // output = input^exponent, 2 is the square law of most dimmer curves
+    static DMXcurve power(float exponent)
+    {
+        std::vector<float> table(resolution+1);
+        for(int i = 0; i <= resolution; i++)
+        {
+            table[i] = powf((float) i / resolution, exponent);
+        }
+        return DMXcurve(table);
+    };
+
+    // smoothstep, slow at both ends
+    static DMXcurve smoothstep()
+    {
+        std::vector<float> table(resolution+1);
+        for(int i = 0; i <= resolution; i++)
+        {
+            float x = (float) i / resolution;
+            table[i] = x*x*(3.-2.*x);
+        }
+        return DMXcurve(table);
+    };
+
+    // shared instances of the common curves
+
+    static const DMXcurve * squareLaw()
+    {
+        static const DMXcurve curve = power(2.);
+        return &curve;
+    };
+
+    static const DMXcurve * inverseSquareLaw()
+    {
+        static const DMXcurve curve = power(0.5);
+        return &curve;
+    };
+
+    static const DMXcurve * sCurve()
+    {
+        static const DMXcurve curve = smoothstep();
+        return &curve;
+    };
+
+protected:
+
+    std::vector<float> lut;
+
+};
@@ -0,0 +1,279 @@
+//
+//  DMXddpOutput.h
+//  ofxOlaShaderLight
+//
+//  Sends pixel groups to LED controllers with DDP, independent of
+//  openFrameworks.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include "DMXclock.h"
+#include "DMXpixels.h"
+#include "DMXudp.h"
+
+// DDP (Distributed Display Protocol) addresses a controller's pixels as
+// one byte array, so a group goes out as a few large packets straight from
+// its packed pixels, at any length, instead of being cut into universes.
+// Every packet is a 10 byte header, built once per group, and a slice of
+// the group's data; the kernel gathers the two.
+// Controllers only show a frame on a packet with the push flag. When a
+// frame goes to more than one controller, all of its data is sent first
+// and the pushes after, so every controller shows the frame together.
+// Call send() from the thread that writes the groups.
+
+class DMXddpOutput
+{
+public:
+
+    static const unsigned short port = 4048;
+
+    DMXddpOutput()
+    {
+        maxPayload = 1440;
+        keepAliveMillis = 1000;
+        pushBroadcast = false;
+    };
+
+    bool setup()
+    {
+        if(!udp.open(0, true))
+        {
+            std::cerr << "DDP socket failed" << std::endl;
+            return false;
+        }
+        return true;
+    };
+
+    // returns the controller's index, -1 if host isn't an IPv4 address
+    int addController(const std::string & host, unsigned short controllerPort = port)
+    {
+        Controller c;
+        if(!DMXudpSocket::address(host, controllerPort, c.address))
+        {
+            std::cerr << "DDP: " << host << " is not an IPv4 address" << std::endl;
+            return -1;
+        }
+        c.sequence = 0;
+        buildHeader(c.pushHeader, DDP_PUSH, 0, DESTINATION_DISPLAY, 0, 0);
+        controllers.push_back(c);
+        return controllers.size() - 1;
+    };
+
+    // sends group's pixels to a controller, from pixel offset on. The
+    // group stays the app's and must outlive its use here.
+    void addGroup(DMXpixelGroup * group, unsigned int controller, unsigned int offset = 0)
+    {
+        if(controller >= controllers.size())
+        {
+            return;
+        }
+        Group g;
+        g.group = group;
+        g.controller = controller;
+        g.offset = offset * group->getBytesPerPixel();
+        g.headerBytes = 0;
+        g.sentGeneration = group->getGeneration() - 1;
+        g.lastSent = 0;
+        groups.push_back(g);
+    };
+
+    void removeGroup(DMXpixelGroup * group)
+    {
+        for(size_t i = groups.size(); i > 0; i--)
+        {
+            if(groups[i-1].group == group)
+            {
+                groups.erase(groups.begin() + i - 1);
+            }
+        }
+    };
+
+    // bytes of pixel data per packet, a multiple of 12 so RGB and RGBW
+    // pixels never straddle two packets. Up to 8928 on jumbo frame networks.
+    void setMaxPayload(unsigned int bytes)
+    {
+        maxPayload = std::max(12u, std::min(bytes, 8928u) / 12 * 12);
+        for(size_t i = 0; i < groups.size(); i++)
+        {
+            groups[i].headerBytes = 0;
+        }
+    };
+
+    // pushes with one broadcast to every controller instead of one to each
+    bool setPushBroadcast(const std::string & host)
+    {
+        pushBroadcast = DMXudpSocket::address(host, port, broadcastAddress);
+        buildHeader(broadcastHeader, DDP_PUSH, 0, DESTINATION_ALL, 0, 0);
+        return pushBroadcast;
+    };
+
+    // how often an unchanged group is resent, controllers leave realtime
+    // mode when nothing arrives for a while
+    void setKeepAliveInterval(unsigned int millis)
+    {
+        keepAliveMillis = millis;
+    };
+
+    // sends every group that changed or is due for a keep-alive
+    void send()
+    {
+        if(!udp.isOpen())
+        {
+            return;
+        }
+        unsigned long long now = DMXmicros() / 1000;
+        for(size_t c = 0; c < controllers.size(); c++)
+        {
+            controllers[c].lastHeader = NULL;
+            controllers[c].sequence = controllers[c].sequence % 15 + 1;
+        }
+        for(size_t i = 0; i < groups.size(); i++)
+        {
+            Group & g = groups[i];
+            DMXpixelGroup * group = g.group;
+            if(group->getGeneration() == g.sentGeneration && now - g.lastSent < keepAliveMillis)
+            {
+                continue;
+            }
+            if(g.headerBytes != group->getDataSize())
+            {
+                buildHeaders(g);
+            }
+            Controller & c = controllers[g.controller];
+            const unsigned char * data = group->getData();
+            unsigned int size = group->getDataSize();
+            for(unsigned int k = 0; k * maxPayload < size; k++)
+            {
+                unsigned char * header = &g.headers[k * HEADER_SIZE];
+                header[0] = DDP_VERSION;
+                header[1] = c.sequence;
+                udp.queue(header, HEADER_SIZE, data + k * maxPayload, std::min(maxPayload, size - k * maxPayload), c.address);
+                c.lastHeader = header;
+            }
+            g.sentGeneration = group->getGeneration();
+            g.lastSent = now;
+        }
+        push();
+        if(!udp.send())
+        {
+            std::cerr << "DDP send failed" << std::endl;
+        }
+    };
+
+protected:
+
+    enum {
+        HEADER_SIZE = 10,
+        DDP_VERSION = 0x40,
+        DDP_PUSH = 0x41,
+        DESTINATION_DISPLAY = 1,
+        DESTINATION_ALL = 255,
+        // 8 bit RGB and RGBW
+        TYPE_RGB = 0x0b,
+        TYPE_RGBW = 0x1b
+    };
+
+    struct Controller
+    {
+        sockaddr_in address;
+        unsigned char sequence;
+        unsigned char pushHeader[HEADER_SIZE];
+        // the last header queued for the controller this frame
+        unsigned char * lastHeader;
+    };
+
+    struct Group
+    {
+        DMXpixelGroup * group;
+        unsigned int controller;
+        unsigned int offset;
+        std::vector<unsigned char> headers;
+        unsigned int headerBytes;
+        unsigned int sentGeneration;
+        unsigned long long lastSent;
+    };
+
+    static void buildHeader(unsigned char * header, unsigned char flags, unsigned char type, unsigned char destination, unsigned int offset, unsigned int length)
+    {
+        header[0] = flags;
+        header[1] = 0;
+        header[2] = type;
+        header[3] = destination;
+        header[4] = offset >> 24;
+        header[5] = (offset >> 16) & 0xff;
+        header[6] = (offset >> 8) & 0xff;
+        header[7] = offset & 0xff;
+        header[8] = (length >> 8) & 0xff;
+        header[9] = length & 0xff;
+    };
+
+    // one header per packet the group is split into
+    void buildHeaders(Group & g)
+    {
+        unsigned int size = g.group->getDataSize();
+        unsigned int packets = (size + maxPayload - 1) / maxPayload;
+        unsigned char type = g.group->getFormat() == DMXpixelGroup::DMX_PIXEL_RGBW ? TYPE_RGBW : TYPE_RGB;
+        g.headers.resize(packets * HEADER_SIZE);
+        for(unsigned int k = 0; k < packets; k++)
+        {
+            buildHeader(&g.headers[k * HEADER_SIZE], DDP_VERSION, type, DESTINATION_DISPLAY, g.offset + k * maxPayload, std::min(maxPayload, size - k * maxPayload));
+        }
+        g.headerBytes = size;
+    };
+
+    // a controller that got data this frame shows it on its last packet,
+    // unless several did, then they all get a push after all the data
+    void push()
+    {
+        size_t sentTo = 0;
+        Controller * only = NULL;
+        for(size_t c = 0; c < controllers.size(); c++)
+        {
+            if(controllers[c].lastHeader != NULL)
+            {
+                sentTo++;
+                only = &controllers[c];
+            }
+        }
+        if(sentTo == 0)
+        {
+            return;
+        }
+        if(sentTo == 1 && !pushBroadcast)
+        {
+            only->lastHeader[0] = DDP_PUSH;
+            return;
+        }
+        if(pushBroadcast)
+        {
+            udp.queue(broadcastHeader, HEADER_SIZE, broadcastHeader, 0, broadcastAddress);
+            return;
+        }
+        for(size_t c = 0; c < controllers.size(); c++)
+        {
+            Controller & controller = controllers[c];
+            if(controller.lastHeader != NULL)
+            {
+                controller.pushHeader[1] = controller.sequence;
+                udp.queue(controller.pushHeader, HEADER_SIZE, controller.pushHeader, 0, controller.address);
+            }
+        }
+    };
+
+    DMXudpSocket udp;
+    std::vector<Controller> controllers;
+    std::vector<Group> groups;
+    unsigned int maxPayload;
+    unsigned int keepAliveMillis;
+
+    bool pushBroadcast;
+    sockaddr_in broadcastAddress;
+    unsigned char broadcastHeader[HEADER_SIZE];
+
+};
@@ -0,0 +1,1116 @@
+//
+//  DMXengine.h
+//  ofxOlaShaderLight
+//
+//  The DMX evaluation core, independent of openFrameworks.
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include "DMXoutput.h"
+#include "DMXcolor.h"
+#include "DMXprofile.h"
+#include "DMXslotMap.h"
+#include "DMXfade.h"
+#include "DMXlayer.h"
+#include "DMXpixels.h"
+
+// A compiled, flat copy of every DMXchannel of every fixture.
+// Channels are stored as parallel arrays grouped by type, so that
+// DMXengine::update() can evaluate one channel type per tight loop
+// instead of walking fixtures and testing the type of every channel.
+// The table is only rebuilt when the patch changes.
+
+class DMXpatch
+{
+public:
+
+    enum DMXchannelFlags
+    {
+        DMX_CHANNEL_FLAG_16BIT = 1,
+        DMX_CHANNEL_FLAG_INVERTED = 2
+    };
+
+    // per fixture colour inputs, filled before convert()
+    std::vector<float> red, green, blue;
+    std::vector<float> kelvin, coldKelvin, warmKelvin;
+    // 1 / (warm - cold), 0 for an empty temperature range
+    std::vector<float> inverseKelvinRange;
+
+    // 1 for fixtures with a white channel, which is taken out of their
+    // red, green and blue; 0 otherwise
+    std::vector<float> whiteShare;
+
+    // per fixture attributes, indexed [type][fixture], computed by convert()
+    std::vector<float> attributes[DMXchannel::DMX_CHANNEL_TYPES];
+
+    // per channel columns, grouped by type
+    std::vector<DMXuniverse*> universe;
+    std::vector<unsigned int> address;
+    std::vector<unsigned char> type;
+    std::vector<unsigned int> minValue;
+    std::vector<unsigned int> maxValue;
+    std::vector<unsigned char> flags;
+    std::vector<unsigned int> fixture;
+    std::vector<const DMXcurve*> curve;
+    std::vector<float> value;
+
+    // indices of the channels that have a curve
+    std::vector<unsigned int> curvedChannels;
+
+    // quantised output level, 0-255 for 8 bit and 0-65535 for 16 bit channels,
+    // computed as levelOffset + curve(value) * levelScale, which also inverts
+    std::vector<float> levelOffset;
+    std::vector<float> levelScale;
+    std::vector<unsigned short> level;
+
+    // channels of type t are [typeBegin[t], typeBegin[t+1])
+    unsigned int typeBegin[DMXchannel::DMX_CHANNEL_TYPES+1];
+
+    // channel indices of fixture f are fixtureChannels[fixtureBegin[f] .. fixtureBegin[f+1])
+    std::vector<unsigned int> fixtureBegin;
+    std::vector<unsigned int> fixtureChannels;
+
+    unsigned int numFixtures;
+
+    DMXpatch()
+    {
+        begin();
+        end();
+    };
+
+    unsigned int size() const
+    {
+        return address.size();
+    };
+
+    bool usesType(int t) const
+    {
+        return typeBegin[t] != typeBegin[t+1];
+    };
+
+    void begin()
+    {
+        staging.clear();
+        whiteShare.clear();
+        numFixtures = 0;
+    };
+
+    void addFixture(bool extractWhite = false)
+    {
+        whiteShare.push_back(extractWhite ? 1. : 0.);
+        numFixtures++;
+    };
+
+    // address is where the channel lands for this fixture
+    void addChannel(const DMXchannel * c, DMXuniverse * u, unsigned int address)
+    {
+        staging.push_back(StagedChannel(numFixtures-1, c, u, address));
+    };
+
+    void end()
+    {
+        // counting sort by type keeps fixture order within each type
+
+        unsigned int count[DMXchannel::DMX_CHANNEL_TYPES+1] = {0};
+        for(size_t i = 0; i < staging.size(); i++)
+        {
+            count[staging[i].channel->type+1]++;
+        }
+        typeBegin[0] = 0;
+        for(int t = 0; t < DMXchannel::DMX_CHANNEL_TYPES; t++)
+        {
+            typeBegin[t+1] = typeBegin[t] + count[t+1];
+        }
+
+        size_t n = staging.size();
+        universe.resize(n);
+        address.resize(n);
+        type.resize(n);
+        minValue.resize(n);
+        maxValue.resize(n);
+        flags.resize(n);
+        fixture.resize(n);
+        curve.resize(n);
+        value.assign(n, 0.);
+        levelOffset.resize(n);
+        levelScale.resize(n);
+        level.assign(n, 0);
+
+        unsigned int next[DMXchannel::DMX_CHANNEL_TYPES];
+        std::copy(typeBegin, typeBegin+DMXchannel::DMX_CHANNEL_TYPES, next);
+        for(size_t i = 0; i < n; i++)
+        {
+            const DMXchannel * c = staging[i].channel;
+            unsigned int j = next[c->type]++;
+            universe[j] = staging[i].universe;
+            address[j] = staging[i].address;
+            type[j] = c->type;
+            minValue[j] = c->minValue;
+            maxValue[j] = c->maxValue;
+            flags[j] = (c->width16bit ? DMX_CHANNEL_FLAG_16BIT : 0) | (c->inverted ? DMX_CHANNEL_FLAG_INVERTED : 0);
+            // min and max are 8 bit values, 16 bit channels scale them by 257 so 255 maps to 65535
+            float unit = c->width16bit ? 257. : 1.;
+            float range = ((float) c->maxValue - (float) c->minValue) * unit;
+            levelOffset[j] = c->inverted ? c->minValue * unit + range : c->minValue * unit;
+            levelScale[j] = c->inverted ? -range : range;
+            fixture[j] = staging[i].fixture;
+            curve[j] = c->curve;
+        }
+        staging.clear();
+
+        curvedChannels.clear();
+        for(size_t j = 0; j < n; j++)
+        {
+            if(curve[j] != NULL)
+            {
+                curvedChannels.push_back(j);
+            }
+        }
+
+        fixtureBegin.assign(numFixtures+1, 0);
+        for(size_t j = 0; j < n; j++)
+        {
+            fixtureBegin[fixture[j]+1]++;
+        }
+        for(unsigned int f = 0; f < numFixtures; f++)
+        {
+            fixtureBegin[f+1] += fixtureBegin[f];
+        }
+        fixtureChannels.resize(n);
+        std::vector<unsigned int> nextChannel(fixtureBegin.begin(), fixtureBegin.end()-1);
+        for(size_t j = 0; j < n; j++)
+        {
+            fixtureChannels[nextChannel[fixture[j]]++] = j;
+        }
+
+        red.assign(numFixtures, 0.);
+        green.assign(numFixtures, 0.);
+        blue.assign(numFixtures, 0.);
+        kelvin.assign(numFixtures, 0.);
+        coldKelvin.assign(numFixtures, 0.);
+        warmKelvin.assign(numFixtures, 0.);
+        inverseKelvinRange.assign(numFixtures, 0.);
+        for(int t = 0; t < DMXchannel::DMX_CHANNEL_TYPES; t++)
+        {
+            attributes[t].assign(usesType(t) ? numFixtures : 0, 0.);
+        }
+    };
+
+    // converts the colour inputs of fixtures [begin, end) into every
+    // attribute the patch uses, one pass per attribute. The passes are
+    // branch free so they vectorise; hue only does so without trapping
+    // maths, as its selects aren't plain min or max.
+    void convert(unsigned int begin, unsigned int end)
+    {
+        if(begin >= end)
+        {
+            return;
+        }
+        const float * r = &red[0];
+        const float * g = &green[0];
+        const float * b = &blue[0];
+
+        // white is what red, green and blue have in common
+        if(usesType(DMXchannel::DMX_CHANNEL_WHITE))
+        {
+            float * white = &attributes[DMXchannel::DMX_CHANNEL_WHITE][0];
+            for(unsigned int i = begin; i < end; i++)
+            {
+                float w = minimum(r[i], g[i], b[i]);
+                white[i] = (w > 0.f ? w : 0.f) * whiteShare[i];
+            }
+            convertPrimary(DMXchannel::DMX_CHANNEL_RED, r, white, begin, end);
+            convertPrimary(DMXchannel::DMX_CHANNEL_GREEN, g, white, begin, end);
+            convertPrimary(DMXchannel::DMX_CHANNEL_BLUE, b, white, begin, end);
+        }
+        else
+        {
+            convertPrimary(DMXchannel::DMX_CHANNEL_RED, r, NULL, begin, end);
+            convertPrimary(DMXchannel::DMX_CHANNEL_GREEN, g, NULL, begin, end);
+            convertPrimary(DMXchannel::DMX_CHANNEL_BLUE, b, NULL, begin, end);
+        }
+
+        if(usesType(DMXchannel::DMX_CHANNEL_BRIGHTNESS))
+        {
+            float * brightness = &attributes[DMXchannel::DMX_CHANNEL_BRIGHTNESS][0];
+            for(unsigned int i = begin; i < end; i++)
+            {
+                brightness[i] = maximum(r[i], g[i], b[i]);
+            }
+        }
+
+        // the same as DMXcolor::rgbToHsb, with selects instead of branches
+        if(usesType(DMXchannel::DMX_CHANNEL_HUE))
+        {
+            float * hue = &attributes[DMXchannel::DMX_CHANNEL_HUE][0];
+            for(unsigned int i = begin; i < end; i++)
+            {
+                float max = maximum(r[i], g[i], b[i]);
+                float min = minimum(r[i], g[i], b[i]);
+                // FLT_MIN keeps grays at 0 instead of dividing by zero
+                float inverse = 1.f / (max - min + FLT_MIN);
+                float sixth = r[i] == max ? (g[i] - b[i]) * inverse : (g[i] == max ? 2.f + (b[i] - r[i]) * inverse : 4.f + (r[i] - g[i]) * inverse);
+                hue[i] = (sixth < 0.f ? sixth + 6.f : sixth) / 6.f;
+            }
+        }
+        if(usesType(DMXchannel::DMX_CHANNEL_SATURATION))
+        {
+            float * saturation = &attributes[DMXchannel::DMX_CHANNEL_SATURATION][0];
+            for(unsigned int i = begin; i < end; i++)
+            {
+                float max = maximum(r[i], g[i], b[i]);
+                float min = minimum(r[i], g[i], b[i]);
+                saturation[i] = (max - min) / (max + FLT_MIN);
+            }
+        }
+
+        // CW rises from the cold end of the fixture's temperature range and
+        // is full from its middle on, WW the same from the warm end. Both
+        // follow the brightness.
+        if(usesType(DMXchannel::DMX_CHANNEL_CW))
+        {
+            float * cw = &attributes[DMXchannel::DMX_CHANNEL_CW][0];
+            for(unsigned int i = begin; i < end; i++)
+            {
+                float fromCold = (kelvin[i] - coldKelvin[i]) * inverseKelvinRange[i];
+                cw[i] = std::min(1.f, fromCold * 2.f) * maximum(r[i], g[i], b[i]);
+            }
+        }
+        if(usesType(DMXchannel::DMX_CHANNEL_WW))
+        {
+            float * ww = &attributes[DMXchannel::DMX_CHANNEL_WW][0];
+            for(unsigned int i = begin; i < end; i++)
+            {
+                float fromWarm = (warmKelvin[i] - kelvin[i]) * inverseKelvinRange[i];
+                ww[i] = std::min(1.f, fromWarm * 2.f) * maximum(r[i], g[i], b[i]);
+            }
+        }
+        if(usesType(DMXchannel::DMX_CHANNEL_COLOR_TEMPERATURE))
+        {
+            float * colorTemperature = &attributes[DMXchannel::DMX_CHANNEL_COLOR_TEMPERATURE][0];
+            for(unsigned int i = begin; i < end; i++)
+            {
+                colorTemperature[i] = (warmKelvin[i] - kelvin[i]) * inverseKelvinRange[i];
+            }
+        }
+    };
+
+    // gathers the normalised value of every channel from the fixture
+    // attributes and quantises it
+    void evaluate()
+    {
+        for(int t = 0; t < DMXchannel::DMX_CHANNEL_TYPES; t++)
+        {
+            const float * attribute = attributes[t].empty() ? NULL : &attributes[t][0];
+            for(unsigned int i = typeBegin[t]; i < typeBegin[t+1]; i++)
+            {
+                value[i] = attribute[fixture[i]];
+            }
+        }
+        for(size_t k = 0; k < curvedChannels.size(); k++)
+        {
+            unsigned int j = curvedChannels[k];
+            value[j] = curve[j]->apply(value[j]);
+        }
+        quantise(0, value.size());
+    };
+
+    // one kernel for 8 and 16 bit channels, branch free so it vectorises.
+    // curves must already have been applied to value
+    void quantise(size_t begin, size_t end)
+    {
+        for(size_t i = begin; i < end; i++)
+        {
+            float v = value[i];
+            v = v < 0. ? 0. : (v > 1. ? 1. : v);
+            level[i] = (unsigned short) (levelOffset[i] + v * levelScale[i] + 0.5f);
+        }
+    };
+
+    // same as evaluate(), restricted to the channels of one fixture
+    void evaluateFixture(unsigned int f)
+    {
+        for(unsigned int k = fixtureBegin[f]; k < fixtureBegin[f+1]; k++)
+        {
+            unsigned int j = fixtureChannels[k];
+            value[j] = attributes[type[j]][f];
+            if(curve[j] != NULL)
+            {
+                value[j] = curve[j]->apply(value[j]);
+            }
+            quantise(j, j+1);
+        }
+    };
+
+protected:
+
+    // red, green or blue less the white that RGBW fixtures take out of it
+    void convertPrimary(int type, const float * primary, const float * white, unsigned int begin, unsigned int end)
+    {
+        if(!usesType(type))
+        {
+            return;
+        }
+        float * out = &attributes[type][0];
+        if(white == NULL)
+        {
+            std::copy(primary+begin, primary+end, out+begin);
+            return;
+        }
+        for(unsigned int i = begin; i < end; i++)
+        {
+            out[i] = primary[i] - white[i];
+        }
+    };
+
+    // fmaxf and fminf handle NaNs, which keeps them from vectorising
+    static inline float maximum(float r, float g, float b)
+    {
+        float m = r > g ? r : g;
+        return m > b ? m : b;
+    };
+
+    static inline float minimum(float r, float g, float b)
+    {
+        float m = r < g ? r : g;
+        return m < b ? m : b;
+    };
+
+    struct StagedChannel
+    {
+        StagedChannel(unsigned int fixture, const DMXchannel * channel, DMXuniverse * universe, unsigned int address) : fixture(fixture), channel(channel), universe(universe), address(address) {};
+        unsigned int fixture;
+        const DMXchannel * channel;
+        DMXuniverse * universe;
+        unsigned int address;
+    };
+
+    std::vector<StagedChannel> staging;
+
+};
+
+// A fixture as plain data. Setting colour or temperature must be
+// followed by DMXengine::markChanged() for the next update() to see it;
+// profile, start address and universe go through DMXengine::setProfile().
+// Position and attenuation are only used for shading.
+
+struct DMXfixtureState
+{
+    DMXfixtureState()
+    {
+        x = y = z = 0.;
+        attenuation = 1.;
+        r = g = b = 0.;
+        temperature = 0;
+        temperatureRangeColdKelvin = 0;
+        temperatureRangeWarmKelvin = 0;
+        profile = NULL;
+        startAddress = 0;
+        universe = 0;
+        owner = NULL;
+        changeGeneration = 0;
+        evaluatedGeneration = 0;
+        queuedForUpdate = false;
+        patchIndex = 0;
+        fading = false;
+    };
+
+    float x, y, z;
+    float attenuation;
+
+    // diffuse colour, brightness is the largest component
+    float r, g, b;
+    unsigned int temperature;
+    unsigned int temperatureRangeColdKelvin;
+    unsigned int temperatureRangeWarmKelvin;
+
+    // shared channel layout, not owned; NULL leaves the fixture unpatched
+    const DMXprofile * profile;
+    int startAddress;
+    unsigned int universe;
+
+    // the object this state belongs to, e.g. its DMXfixture, or NULL
+    void * owner;
+
+    unsigned int changeGeneration;
+    unsigned int evaluatedGeneration;
+    bool queuedForUpdate;
+    unsigned int patchIndex;
+    bool fading;
+};
+
+// Evaluates fixture states into universes and hands them to a DMXoutput.
+// Nothing in here depends on openFrameworks or a GL context, so it runs
+// just as well in a headless output node.
+
+class DMXengine
+{
+public:
+
+    DMXengine(DMXtransport * transport) : output(transport)
+    {
+        patchChanged = true;
+        channelFadesChanged = false;
+        source = NULL;
+        clock = NULL;
+        layers.push_back(&fixtureLayer);
+    };
+
+    ~DMXengine()
+    {
+        output.stopThread();
+    };
+
+    DMXhandle addFixture(void * owner = NULL)
+    {
+        DMXfixtureState state;
+        state.owner = owner;
+        invalidatePatch();
+        return fixtures.insert(state);
+    };
+
+    // O(1), a queued handle of the fixture simply stops resolving
+    void removeFixture(DMXhandle handle)
+    {
+        stopFade(handle);
+        invalidatePatch();
+        fixtures.erase(handle);
+    };
+
+    // NULL once the fixture has been removed
+    DMXfixtureState * getFixture(DMXhandle handle)
+    {
+        return fixtures.get(handle);
+    };
+
+    void setProfile(DMXhandle handle, const DMXprofile * profile, int startAddress, unsigned int universe = 0)
+    {
+        DMXfixtureState * f = fixtures.get(handle);
+        if(f != NULL)
+        {
+            f->profile = profile;
+            f->startAddress = startAddress;
+            f->universe = universe;
+            invalidatePatch();
+        }
+    };
+
+    // queues the fixture for evaluation in the next update()
+    void markChanged(DMXhandle handle)
+    {
+        DMXfixtureState * f = fixtures.get(handle);
+        if(f == NULL)
+        {
+            return;
+        }
+        f->changeGeneration++;
+        if(!f->queuedForUpdate)
+        {
+            f->queuedForUpdate = true;
+            dirtyFixtures.push_back(handle);
+        }
+    };
+
+    void invalidatePatch()
+    {
+        patchChanged = true;
+    };
+
+    // sets fixture handles[i] to colour i of r, g and b, e.g. the colours
+    // of a DMXpixelMap; stops their fades
+    void setColors(const std::vector<DMXhandle> & handles, const float * r, const float * g, const float * b)
+    {
+        for(size_t i = 0; i < handles.size(); i++)
+        {
+            DMXfixtureState * f = fixtures.get(handles[i]);
+            if(f == NULL)
+            {
+                continue;
+            }
+            stopFade(handles[i]);
+            f->r = r[i];
+            f->g = g[i];
+            f->b = b[i];
+            markChanged(handles[i]);
+        }
+    };
+
+    // fades the fixture's colour and temperature from where they are now
+    // to the target, replacing a fade it is already running. update()
+    // moves the state along; the fixture's DMX channels are interpolated
+    // by the output for every frame it sends.
+    void fadeTo(DMXhandle handle, float r, float g, float b, unsigned int temperature, float seconds, const DMXcurve * curve = NULL)
+    {
+        DMXfixtureState * f = fixtures.get(handle);
+        if(f == NULL)
+        {
+            return;
+        }
+        stopFade(handle);
+        if(seconds <= 0.)
+        {
+            f->r = r;
+            f->g = g;
+            f->b = b;
+            f->temperature = temperature;
+            markChanged(handle);
+            return;
+        }
+        float from[DMXfixtureFades::DMX_FADE_ATTRIBUTES] = {f->r, f->g, f->b, (float) f->temperature};
+        float to[DMXfixtureFades::DMX_FADE_ATTRIBUTES] = {r, g, b, (float) temperature};
+        unsigned long long start = getMicros();
+        unsigned long long duration = seconds * 1000000.;
+        fades.add(handle, from, to, start, duration, curve);
+        f->fading = true;
+        newFades.push_back(ChannelFade(handle, 0, start, duration, curve));
+    };
+
+    // leaves the fixture where its fade has got to
+    void stopFade(DMXhandle handle)
+    {
+        DMXfixtureState * f = fixtures.get(handle);
+        if(f == NULL || !f->fading)
+        {
+            return;
+        }
+        int i = fades.find(handle);
+        if(i >= 0)
+        {
+            fades.erase(i);
+        }
+        removeChannelFades(handle);
+        f->fading = false;
+    };
+
+    bool isFading(DMXhandle handle)
+    {
+        DMXfixtureState * f = fixtures.get(handle);
+        return f != NULL && f->fading;
+    };
+
+    // the fixtures whose state a fade changed in the last update()
+    const std::vector<DMXhandle> & getFadedFixtures()
+    {
+        return fadedFixtures;
+    };
+
+    // fills the fixture layer from source instead of the fixtures, NULL
+    // goes back to the fixtures. Either way the layer starts out empty, so
+    // universes only the fixtures or strips set aren't sent on at their
+    // last levels; the repatch fills them in again.
+    void setSource(DMXuniverseSource * source)
+    {
+        this->source = source;
+        fixtureLayer.releaseAll();
+        if(source != NULL)
+        {
+            source->invalidate();
+        }
+        channelFades.clear();
+        channelFadesChanged = true;
+        invalidatePatch();
+    };
+
+    DMXuniverseSource * getSource()
+    {
+        return source;
+    };
+
+    // the fixture layer's buffer of a universe, allocated on first use
+    DMXuniverse * getUniverse(unsigned int number)
+    {
+        return fixtureLayer.getUniverse(number);
+    };
+
+    // where the fixtures, or the source replacing them, are evaluated to.
+    // HTP at priority 100 unless changed.
+    DMXlayer & getFixtureLayer()
+    {
+        return fixtureLayer;
+    };
+
+    // merges layer with the fixture layer and the other layers; the layer
+    // must stay alive until it is removed
+    void addLayer(DMXlayer * layer)
+    {
+        if(std::find(layers.begin(), layers.end(), layer) == layers.end())
+        {
+            layers.push_back(layer);
+        }
+    };
+
+    void removeLayer(DMXlayer * layer)
+    {
+        if(layer != &fixtureLayer)
+        {
+            layers.erase(std::remove(layers.begin(), layers.end(), layer), layers.end());
+        }
+    };
+
+    // writes the strip into the fixture layer whenever its pixels change;
+    // the strip must stay alive until it is removed
+    void addPixelStrip(DMXpixelStrip * strip)
+    {
+        for(size_t i = 0; i < pixelStrips.size(); i++)
+        {
+            if(pixelStrips[i].strip == strip)
+            {
+                return;
+            }
+        }
+        if(strip->getStartAddress() > MAX_DMX_CHANNELS)
+        {
+            std::cerr << "DMXengine: pixel strip start address " << strip->getStartAddress() << " is past slot " << MAX_DMX_CHANNELS << ", the strip is not written" << std::endl;
+        }
+        PixelStrip p;
+        p.strip = strip;
+        p.writtenGeneration = strip->getGeneration() - 1;
+        p.layoutGeneration = strip->getLayoutGeneration();
+        p.dataSize = strip->getDataSize();
+        pixelStrips.push_back(p);
+    };
+
+    void removePixelStrip(DMXpixelStrip * strip)
+    {
+        for(size_t i = pixelStrips.size(); i > 0; i--)
+        {
+            if(pixelStrips[i-1].strip == strip)
+            {
+                pixelStrips.erase(pixelStrips.begin() + i - 1);
+                // releases its slots
+                invalidatePatch();
+            }
+        }
+    };
+
+    DMXoutput & getOutput()
+    {
+        return output;
+    };
+
+    // runs fades and the source on show time, NULL goes back to the steady
+    // clock. Set it before fading, fades under way would jump.
+    void setClock(DMXclock * clock)
+    {
+        this->clock = clock;
+        output.setClock(clock);
+    };
+
+    DMXclock * getClock()
+    {
+        return clock;
+    };
+
+    // the time fades and the source are measured in
+    unsigned long long getMicros()
+    {
+        return clock != NULL ? clock->getMicros() : DMXmicros();
+    };
+
+    void update()
+    {
+        unsigned long long now = getMicros();
+
+        if(source != NULL)
+        {
+            // a pre-rendered show replaces the fixtures
+            source->fillUniverses(fixtureLayer, now);
+        }
+        else
+        {
+            bool repatch = movePixelStrips() || patchChanged;
+            evaluateFixtures(now);
+            writePixelStrips(repatch);
+        }
+        for(size_t l = 1; l < layers.size(); l++)
+        {
+            if(layers[l]->getSource() != NULL)
+            {
+                layers[l]->getSource()->fillUniverses(*layers[l], now);
+            }
+        }
+
+        // merge what changed and hand the universes to the output, which
+        // sends the changed ones
+
+        bool changed = merger.merge(layers);
+        if(changed || channelFadesChanged)
+        {
+            DMXframe & frame = output.getBackFrame();
+            frame.resize(merger.universes.size());
+            size_t i = 0;
+            for(std::map<unsigned int, DMXmerger::MergedUniverse*>::iterator it = merger.universes.begin(); it != merger.universes.end(); it++)
+            {
+                // a universe nothing sets any more, e.g. after its last
+                // fixture was unpatched, is left to whatever else drives it
+                if(!it->second->live)
+                {
+                    it->second->universe.clean();
+                    continue;
+                }
+                frame.numbers[i] = it->first;
+                memcpy(frame.getSlots(i), it->second->universe.slots, MAX_DMX_CHANNELS);
+                it->second->universe.clean();
+                DMXuniverse * u = fixtureLayer.findUniverse(it->first);
+                if(u != NULL)
+                {
+                    u->frameIndex = i;
+                }
+                i++;
+            }
+            frame.resize(i);
+            frame.fades.clear();
+            for(std::vector<ChannelFade>::iterator it = channelFades.begin(); it != channelFades.end(); it++)
+            {
+                unsigned int j = it->channel;
+                // where other layers merge in, fades go on at the app's rate
+                if(patch.universe[j]->shared)
+                {
+                    continue;
+                }
+                // as in updateChannelValue(), slots past the universe are dropped
+                bool width16bit = patch.flags[j] & DMXpatch::DMX_CHANNEL_FLAG_16BIT;
+                if(patch.address[j] < 1 || patch.address[j] + (width16bit ? 1 : 0) > MAX_DMX_CHANNELS)
+                {
+                    continue;
+                }
+                frame.fades.add(patch.universe[j]->frameIndex, patch.address[j], width16bit, it->from, it->to, it->start, it->duration, it->curve);
+            }
+            channelFadesChanged = false;
+            output.publish();
+        }
+        if(!output.isThreadRunning())
+        {
+            output.sendLatest();
+        }
+    };
+
+    static void updateChannelValue(DMXuniverse * u, int channel, int value)
+    {
+        if(channel < 1 || channel > MAX_DMX_CHANNELS)
+        {
+            return;
+        }
+        u->set(channel-1, value);
+    };
+
+    // packed, iterate with fixtures[i] for i < fixtures.size()
+    DMXslotMap<DMXfixtureState> fixtures;
+
+protected:
+
+    // evaluates the fixtures into the universes, all of them after a
+    // repatch and otherwise only those that changed
+    void evaluateFixtures(unsigned long long now)
+    {
+        bool evaluateAll = patchChanged;
+
+        if(patchChanged)
+        {
+            // channel fades refer to patch channels, so running fades go on
+            // at the app's rate until they end
+            channelFades.clear();
+            channelFadesChanged = true;
+            compilePatch();
+        }
+        startChannelFades();
+        updateFades(now);
+
+        if(evaluateAll)
+        {
+            for(unsigned int i = 0; i < fixtures.size(); i++)
+            {
+                updatePatchInputs(fixtures[i], i);
+            }
+            patch.convert(0, patch.numFixtures);
+            patch.evaluate();
+            for(unsigned int j = 0; j < patch.size(); j++)
+            {
+                updatePatchChannel(j);
+            }
+        }
+        else
+        {
+            // only fixtures that changed since the last update are evaluated
+
+            for(std::vector<DMXhandle>::iterator it = dirtyFixtures.begin(); it != dirtyFixtures.end(); it++)
+            {
+                // fixtures removed since they were queued no longer resolve
+                DMXfixtureState * f = fixtures.get(*it);
+                if(f == NULL)
+                {
+                    continue;
+                }
+                if(f->changeGeneration != f->evaluatedGeneration)
+                {
+                    updatePatchInputs(*f, f->patchIndex);
+                    patch.convert(f->patchIndex, f->patchIndex+1);
+                    patch.evaluateFixture(f->patchIndex);
+                    for(unsigned int k = patch.fixtureBegin[f->patchIndex]; k < patch.fixtureBegin[f->patchIndex+1]; k++)
+                    {
+                        updatePatchChannel(patch.fixtureChannels[k]);
+                    }
+                }
+            }
+        }
+
+        for(std::vector<DMXhandle>::iterator it = dirtyFixtures.begin(); it != dirtyFixtures.end(); it++)
+        {
+            DMXfixtureState * f = fixtures.get(*it);
+            if(f != NULL)
+            {
+                f->evaluatedGeneration = f->changeGeneration;
+                f->queuedForUpdate = false;
+            }
+        }
+        dirtyFixtures.clear();
+    };
+
+    // a strip that moved or changed size leaves slots behind, which only
+    // a repatch releases
+    bool movePixelStrips()
+    {
+        bool moved = false;
+        for(size_t i = 0; i < pixelStrips.size(); i++)
+        {
+            PixelStrip & p = pixelStrips[i];
+            if(p.layoutGeneration != p.strip->getLayoutGeneration() || p.dataSize != p.strip->getDataSize())
+            {
+                p.layoutGeneration = p.strip->getLayoutGeneration();
+                p.dataSize = p.strip->getDataSize();
+                moved = true;
+            }
+        }
+        if(moved)
+        {
+            invalidatePatch();
+        }
+        return moved;
+    };
+
+    // writes the strips that changed, all of them after a repatch cleared
+    // the fixture layer
+    void writePixelStrips(bool all)
+    {
+        for(size_t i = 0; i < pixelStrips.size(); i++)
+        {
+            PixelStrip & p = pixelStrips[i];
+            if(all || p.writtenGeneration != p.strip->getGeneration())
+            {
+                p.strip->write(fixtureLayer);
+                p.writtenGeneration = p.strip->getGeneration();
+            }
+        }
+    };
+
+    void compilePatch()
+    {
+        // the whole rig is evaluated against cleared universes
+        fixtureLayer.releaseAll();
+        patch.begin();
+        for(unsigned int i = 0; i < fixtures.size(); i++)
+        {
+            DMXfixtureState & f = fixtures[i];
+            f.patchIndex = patch.numFixtures;
+            patch.addFixture(f.profile != NULL && f.profile->usesType(DMXchannel::DMX_CHANNEL_WHITE));
+            if(f.profile == NULL || f.startAddress < 1)
+            {
+                continue;
+            }
+            // profile addresses and universes are relative to the fixture's
+            const std::vector<DMXchannel> & channels = f.profile->channels;
+            for(std::vector<DMXchannel>::const_iterator chIt = channels.begin(); chIt != channels.end(); chIt++)
+            {
+                patch.addChannel(&(*chIt), getUniverse(f.universe + chIt->universe), f.startAddress + chIt->address - 1);
+            }
+        }
+        patch.end();
+        patchChanged = false;
+    };
+
+    // copies the colour inputs of fixture f to patch index i
+    void updatePatchInputs(const DMXfixtureState & f, unsigned int i)
+    {
+        patch.red[i] = f.r;
+        patch.green[i] = f.g;
+        patch.blue[i] = f.b;
+        patch.kelvin[i] = f.temperature;
+        patch.coldKelvin[i] = f.temperatureRangeColdKelvin;
+        patch.warmKelvin[i] = f.temperatureRangeWarmKelvin;
+        float range = (float) f.temperatureRangeWarmKelvin - (float) f.temperatureRangeColdKelvin;
+        patch.inverseKelvinRange[i] = fabsf(range) < FLT_EPSILON ? 0. : 1. / range;
+    };
+
+    struct ChannelFade
+    {
+        ChannelFade(DMXhandle fixture, unsigned int channel, unsigned long long start, unsigned long long duration, const DMXcurve * curve) : fixture(fixture), channel(channel), from(0), to(0), start(start), duration(duration), curve(curve) {};
+        DMXhandle fixture;
+        unsigned int channel;
+        unsigned short from;
+        unsigned short to;
+        unsigned long long start;
+        unsigned long long duration;
+        const DMXcurve * curve;
+    };
+
+    // evaluates patch index i as fixture f with the colour and temperature
+    // in value, indexed by DMXfixtureFades::DMXfadeAttribute
+    void evaluatePatchFixture(const DMXfixtureState & f, unsigned int i, const float * value)
+    {
+        updatePatchInputs(f, i);
+        patch.red[i] = value[DMXfixtureFades::DMX_FADE_RED];
+        patch.green[i] = value[DMXfixtureFades::DMX_FADE_GREEN];
+        patch.blue[i] = value[DMXfixtureFades::DMX_FADE_BLUE];
+        patch.kelvin[i] = value[DMXfixtureFades::DMX_FADE_TEMPERATURE];
+        patch.convert(i, i+1);
+        patch.evaluateFixture(i);
+    };
+
+    // turns the fixture fades started since the last update into fades of
+    // their channel levels, for the output to interpolate
+    void startChannelFades()
+    {
+        for(std::vector<ChannelFade>::iterator it = newFades.begin(); it != newFades.end(); it++)
+        {
+            DMXfixtureState * f = fixtures.get(it->fixture);
+            int fade = f != NULL && f->fading ? fades.find(it->fixture) : -1;
+            if(fade < 0)
+            {
+                continue;
+            }
+            removeChannelFades(it->fixture);
+            unsigned int i = f->patchIndex;
+            unsigned int first = patch.fixtureBegin[i];
+            unsigned int last = patch.fixtureBegin[i+1];
+            if(first == last)
+            {
+                continue;
+            }
+            float from[DMXfixtureFades::DMX_FADE_ATTRIBUTES];
+            float to[DMXfixtureFades::DMX_FADE_ATTRIBUTES];
+            for(int a = 0; a < DMXfixtureFades::DMX_FADE_ATTRIBUTES; a++)
+            {
+                from[a] = fades.from[a][fade];
+                to[a] = fades.to[a][fade];
+            }
+            size_t begin = channelFades.size();
+            evaluatePatchFixture(*f, i, from);
+            for(unsigned int k = first; k < last; k++)
+            {
+                ChannelFade c = *it;
+                c.channel = patch.fixtureChannels[k];
+                c.from = patch.level[c.channel];
+                channelFades.push_back(c);
+            }
+            evaluatePatchFixture(*f, i, to);
+            for(size_t k = begin; k < channelFades.size(); k++)
+            {
+                channelFades[k].to = patch.level[channelFades[k].channel];
+            }
+            channelFadesChanged = true;
+        }
+        newFades.clear();
+    };
+
+    // moves every fixture fade along to now, finished fades land exactly
+    // on their target
+    void updateFades(unsigned long long now)
+    {
+        fadedFixtures.clear();
+        fades.evaluate(now);
+        for(int i = (int) fades.size()-1; i >= 0; i--)
+        {
+            DMXhandle handle = fades.fixture[i];
+            DMXfixtureState * f = fixtures.get(handle);
+            if(f == NULL)
+            {
+                fades.erase(i);
+                continue;
+            }
+            bool finished = fades.finished(i, now);
+            const std::vector<float> * value = finished ? fades.to : fades.value;
+            f->r = value[DMXfixtureFades::DMX_FADE_RED][i];
+            f->g = value[DMXfixtureFades::DMX_FADE_GREEN][i];
+            f->b = value[DMXfixtureFades::DMX_FADE_BLUE][i];
+            f->temperature = (unsigned int) (value[DMXfixtureFades::DMX_FADE_TEMPERATURE][i] + 0.5f);
+            markChanged(handle);
+            fadedFixtures.push_back(handle);
+            if(finished)
+            {
+                fades.erase(i);
+                removeChannelFades(handle);
+                f->fading = false;
+            }
+        }
+    };
+
+    void removeChannelFades(DMXhandle handle)
+    {
+        size_t kept = 0;
+        for(size_t k = 0; k < channelFades.size(); k++)
+        {
+            if(channelFades[k].fixture != handle)
+            {
+                channelFades[kept++] = channelFades[k];
+            }
+        }
+        if(kept != channelFades.size())
+        {
+            channelFades.erase(channelFades.begin()+kept, channelFades.end());
+            channelFadesChanged = true;
+        }
+    };
+
+    // writes the level of patch channel j, 16 bit channels as MSB then LSB
+    void updatePatchChannel(unsigned int j)
+    {
+        unsigned int level = patch.level[j];
+        if(patch.flags[j] & DMXpatch::DMX_CHANNEL_FLAG_16BIT)
+        {
+            updateChannelValue(patch.universe[j], patch.address[j], level >> 8);
+            updateChannelValue(patch.universe[j], patch.address[j]+1, level & 0xff);
+        }
+        else
+        {
+            updateChannelValue(patch.universe[j], patch.address[j], level);
+        }
+    };
+
+    DMXoutput output;
+    DMXpatch patch;
+    bool patchChanged;
+    std::vector<DMXhandle> dirtyFixtures;
+
+    DMXlayer fixtureLayer;
+    // the fixture layer first
+    std::vector<DMXlayer*> layers;
+    DMXmerger merger;
+
+    struct PixelStrip
+    {
+        DMXpixelStrip * strip;
+        unsigned int writtenGeneration;
+        unsigned int layoutGeneration;
+        unsigned int dataSize;
+    };
+
+    std::vector<PixelStrip> pixelStrips;
+
+    DMXuniverseSource * source;
+    DMXclock * clock;
+
+    DMXfixtureFades fades;
+    std::vector<ChannelFade> newFades;
+    std::vector<ChannelFade> channelFades;
+    bool channelFadesChanged;
+    std::vector<DMXhandle> fadedFixtures;
+
+};
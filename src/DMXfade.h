@@ -0,0 +1,253 @@
+//
+//  DMXfade.h
+//  ofxOlaShaderLight
+//
+//  Time based fades of fixtures and channel levels, independent of
+//  openFrameworks.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include "DMXclock.h"
+#include "DMXcurve.h"
+#include "DMXslotMap.h"
+
+// Fade progress from 0 at start to 1 after duration, shaped by curve. The
+// progress pass is branch free, the curves are applied afterwards.
+
+class DMXfadeTimes
+{
+public:
+
+    void clear()
+    {
+        start.clear();
+        inverseDuration.clear();
+        curve.clear();
+    };
+
+    size_t size() const
+    {
+        return start.size();
+    };
+
+    void add(unsigned long long startMicros, unsigned long long durationMicros, const DMXcurve * curve)
+    {
+        start.push_back(startMicros);
+        inverseDuration.push_back(1. / (durationMicros > 0 ? durationMicros : 1));
+        this->curve.push_back(curve);
+    };
+
+    void erase(size_t i)
+    {
+        size_t last = size()-1;
+        start[i] = start[last];
+        inverseDuration[i] = inverseDuration[last];
+        curve[i] = curve[last];
+        start.pop_back();
+        inverseDuration.pop_back();
+        curve.pop_back();
+    };
+
+    // fills progress for every fade at now
+    void evaluate(unsigned long long now)
+    {
+        size_t n = size();
+        progress.resize(n);
+        for(size_t i = 0; i < n; i++)
+        {
+            float p = (float) (long long) (now - start[i]) * inverseDuration[i];
+            progress[i] = p < 0. ? 0. : (p > 1. ? 1. : p);
+        }
+        for(size_t i = 0; i < n; i++)
+        {
+            if(curve[i] != NULL)
+            {
+                progress[i] = curve[i]->apply(progress[i]);
+            }
+        }
+    };
+
+    bool finished(size_t i, unsigned long long now) const
+    {
+        return (float) (long long) (now - start[i]) * inverseDuration[i] >= 1.;
+    };
+
+    std::vector<unsigned long long> start;
+    std::vector<float> inverseDuration;
+    std::vector<const DMXcurve*> curve;
+    std::vector<float> progress;
+
+};
+
+// Fades of quantised channel levels, 0-255 for 8 bit and 0-65535 for 16 bit
+// channels, so 16 bit channels get 16 bit intermediate values. They travel
+// with a DMXframe and are evaluated by the sending side for every frame it
+// sends, which makes them as smooth as the output rate, whatever the
+// app's frame rate.
+
+class DMXchannelFades
+{
+public:
+
+    void clear()
+    {
+        times.clear();
+        universe.clear();
+        address.clear();
+        width16bit.clear();
+        from.clear();
+        to.clear();
+    };
+
+    size_t size() const
+    {
+        return universe.size();
+    };
+
+    // universe is the index of the universe in the frame
+    void add(unsigned int universe, unsigned int address, bool width16bit, unsigned short from, unsigned short to, unsigned long long startMicros, unsigned long long durationMicros, const DMXcurve * curve)
+    {
+        times.add(startMicros, durationMicros, curve);
+        this->universe.push_back(universe);
+        this->address.push_back(address);
+        this->width16bit.push_back(width16bit);
+        this->from.push_back(from);
+        this->to.push_back(to);
+    };
+
+    // writes the level every fade has at now into slots, which holds
+    // MAX_DMX_CHANNELS values per universe
+    void apply(unsigned long long now, unsigned char * slots, unsigned int slotsPerUniverse)
+    {
+        times.evaluate(now);
+        for(size_t i = 0; i < size(); i++)
+        {
+            if(address[i] < 1 || address[i] > slotsPerUniverse)
+            {
+                continue;
+            }
+            float f = from[i];
+            unsigned int level = (unsigned int) (f + ((float) to[i] - f) * times.progress[i] + 0.5f);
+            unsigned char * slot = slots + universe[i] * slotsPerUniverse + address[i] - 1;
+            if(width16bit[i])
+            {
+                slot[0] = level >> 8;
+                if(address[i] < slotsPerUniverse)
+                {
+                    slot[1] = level & 0xff;
+                }
+            }
+            else
+            {
+                slot[0] = level;
+            }
+        }
+    };
+
+protected:
+
+    DMXfadeTimes times;
+    std::vector<unsigned int> universe;
+    std::vector<unsigned int> address;
+    std::vector<bool> width16bit;
+    std::vector<unsigned short> from;
+    std::vector<unsigned short> to;
+
+};
+
+// Fades of fixture colour and temperature, kept as parallel arrays so one
+// pass interpolates every running fade.
+
+class DMXfixtureFades
+{
+public:
+
+    enum DMXfadeAttribute
+    {
+        DMX_FADE_RED,
+        DMX_FADE_GREEN,
+        DMX_FADE_BLUE,
+        DMX_FADE_TEMPERATURE,
+        DMX_FADE_ATTRIBUTES
+    };
+
+    size_t size() const
+    {
+        return fixture.size();
+    };
+
+    // from and to hold DMX_FADE_ATTRIBUTES values
+    void add(DMXhandle handle, const float * from, const float * to, unsigned long long startMicros, unsigned long long durationMicros, const DMXcurve * curve)
+    {
+        fixture.push_back(handle);
+        times.add(startMicros, durationMicros, curve);
+        for(int a = 0; a < DMX_FADE_ATTRIBUTES; a++)
+        {
+            this->from[a].push_back(from[a]);
+            this->to[a].push_back(to[a]);
+        }
+    };
+
+    // index of the fade of a fixture, or -1
+    int find(DMXhandle handle) const
+    {
+        for(size_t i = 0; i < fixture.size(); i++)
+        {
+            if(fixture[i] == handle)
+            {
+                return i;
+            }
+        }
+        return -1;
+    };
+
+    // moves the last fade into i
+    void erase(size_t i)
+    {
+        size_t last = size()-1;
+        fixture[i] = fixture[last];
+        fixture.pop_back();
+        times.erase(i);
+        for(int a = 0; a < DMX_FADE_ATTRIBUTES; a++)
+        {
+            from[a][i] = from[a][last];
+            to[a][i] = to[a][last];
+            from[a].pop_back();
+            to[a].pop_back();
+        }
+    };
+
+    // fills value with every attribute of every fade at now
+    void evaluate(unsigned long long now)
+    {
+        times.evaluate(now);
+        size_t n = size();
+        const float * p = n > 0 ? &times.progress[0] : NULL;
+        for(int a = 0; a < DMX_FADE_ATTRIBUTES; a++)
+        {
+            value[a].resize(n);
+            for(size_t i = 0; i < n; i++)
+            {
+                value[a][i] = from[a][i] + (to[a][i] - from[a][i]) * p[i];
+            }
+        }
+    };
+
+    bool finished(size_t i, unsigned long long now) const
+    {
+        return times.finished(i, now);
+    };
+
+    std::vector<DMXhandle> fixture;
+    std::vector<float> from[DMX_FADE_ATTRIBUTES];
+    std::vector<float> to[DMX_FADE_ATTRIBUTES];
+    std::vector<float> value[DMX_FADE_ATTRIBUTES];
+
+protected:
+
+    DMXfadeTimes times;
+
+};
@@ -0,0 +1,513 @@
+//
+//  DMXlayer.h
+//  ofxOlaShaderLight
+//
+//  Layers of sparse universe data and the merge that combines them,
+//  independent of openFrameworks.
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+#include "DMXoutput.h"
+
+// One universe worth of slots. A slot only takes part in merging once it
+// has been set, touched holds 0xff for those and 0 for the rest. The dirty
+// range covers the slots that changed since the universe was last merged.
+
+class DMXuniverse
+{
+public:
+
+    DMXuniverse(unsigned int number)
+    {
+        this->number = number;
+        frameIndex = 0;
+        shared = false;
+        changedAt = 0;
+        blackout();
+    };
+
+    // zeroes and releases every slot
+    void blackout()
+    {
+        memset(slots, 0, MAX_DMX_CHANNELS);
+        memset(touched, 0, MAX_DMX_CHANNELS);
+        dirtyBegin = 0;
+        dirtyEnd = MAX_DMX_CHANNELS;
+    };
+
+    // slot counts from 0
+    void set(unsigned int slot, unsigned char value)
+    {
+        if(slots[slot] != value || !touched[slot])
+        {
+            slots[slot] = value;
+            touched[slot] = 0xff;
+            markDirty(slot, slot+1);
+        }
+    };
+
+    void release(unsigned int slot)
+    {
+        if(touched[slot])
+        {
+            slots[slot] = 0;
+            touched[slot] = 0;
+            markDirty(slot, slot+1);
+        }
+    };
+
+    // sets count slots from begin, only the part that differs is dirtied
+    void setSlots(const unsigned char * values, unsigned int begin = 0, unsigned int count = MAX_DMX_CHANNELS)
+    {
+        unsigned int first = begin;
+        unsigned int last = begin + count;
+        while(first < last && touched[first] && slots[first] == values[first-begin])
+        {
+            first++;
+        }
+        while(last > first && touched[last-1] && slots[last-1] == values[last-1-begin])
+        {
+            last--;
+        }
+        if(first < last)
+        {
+            memcpy(slots + first, values + first - begin, last - first);
+            memset(touched + first, 0xff, last - first);
+            markDirty(first, last);
+        }
+    };
+
+    void markDirty(unsigned int begin, unsigned int end)
+    {
+        dirtyBegin = std::min(dirtyBegin, begin);
+        dirtyEnd = std::max(dirtyEnd, end);
+    };
+
+    bool isDirty() const
+    {
+        return dirtyBegin < dirtyEnd;
+    };
+
+    void clean()
+    {
+        dirtyBegin = MAX_DMX_CHANNELS;
+        dirtyEnd = 0;
+    };
+
+    unsigned int number;
+    unsigned int dirtyBegin;
+    unsigned int dirtyEnd;
+    // where the universe was put in the last published frame
+    unsigned int frameIndex;
+    // whether other layers merge into this universe too
+    bool shared;
+    // the merge it last changed in
+    unsigned long long changedAt;
+    unsigned char slots[MAX_DMX_CHANNELS];
+    unsigned char touched[MAX_DMX_CHANNELS];
+
+};
+
+class DMXlayer;
+
+// Fills a layer's universes, e.g. a DMXplayer playing a pre-rendered show.
+
+class DMXuniverseSource
+{
+public:
+
+    virtual ~DMXuniverseSource() {};
+
+    // called from DMXengine::update(), write to layer.getUniverse()
+    virtual void fillUniverses(DMXlayer & layer, unsigned long long micros) = 0;
+
+    // the layer was cleared, the next fillUniverses() writes every universe
+    virtual void invalidate() {};
+
+};
+
+// A source of universe data that only holds the slots it sets. Layers are
+// merged by priority, the highest priority layer setting a slot owns it.
+// Among layers of equal priority HTP layers give the highest level, as
+// ola::DmxBuffer::HTPMerge does, and an LTP layer takes the slots it sets
+// from the layers that changed before it.
+
+class DMXlayer
+{
+public:
+
+    enum DMXmergeMode
+    {
+        DMX_MERGE_HTP,
+        DMX_MERGE_LTP
+    };
+
+    DMXlayer(DMXmergeMode mode = DMX_MERGE_HTP, unsigned char priority = 100)
+    {
+        this->mode = mode;
+        setPriority(priority);
+        enabled = true;
+        source = NULL;
+        generation = 0;
+    };
+
+    ~DMXlayer()
+    {
+        for(std::map<unsigned int, DMXuniverse*>::iterator it = universes.begin(); it != universes.end(); it++)
+        {
+            delete it->second;
+        }
+    };
+
+    // allocated on first use
+    DMXuniverse * getUniverse(unsigned int number)
+    {
+        std::map<unsigned int, DMXuniverse*>::iterator it = universes.find(number);
+        if(it != universes.end())
+        {
+            return it->second;
+        }
+        DMXuniverse * u = new DMXuniverse(number);
+        universes[number] = u;
+        generation++;
+        return u;
+    };
+
+    // NULL when the layer has never used the universe
+    DMXuniverse * findUniverse(unsigned int number)
+    {
+        std::map<unsigned int, DMXuniverse*>::iterator it = universes.find(number);
+        return it != universes.end() ? it->second : NULL;
+    };
+
+    // channel counts from 1
+    void set(unsigned int universe, int channel, unsigned char value)
+    {
+        if(channel >= 1 && channel <= MAX_DMX_CHANNELS)
+        {
+            getUniverse(universe)->set(channel-1, value);
+        }
+    };
+
+    void release(unsigned int universe, int channel)
+    {
+        DMXuniverse * u = findUniverse(universe);
+        if(u != NULL && channel >= 1 && channel <= MAX_DMX_CHANNELS)
+        {
+            u->release(channel-1);
+        }
+    };
+
+    void releaseAll()
+    {
+        for(std::map<unsigned int, DMXuniverse*>::iterator it = universes.begin(); it != universes.end(); it++)
+        {
+            it->second->blackout();
+        }
+    };
+
+    void setMode(DMXmergeMode mode)
+    {
+        this->mode = mode;
+        generation++;
+    };
+
+    DMXmergeMode getMode()
+    {
+        return mode;
+    };
+
+    // 0 to 254
+    void setPriority(unsigned char priority)
+    {
+        this->priority = std::min(priority, (unsigned char) 254);
+        generation++;
+    };
+
+    unsigned char getPriority()
+    {
+        return priority;
+    };
+
+    // a disabled layer is left out of the merge, but keeps its slots
+    void setEnabled(bool enabled)
+    {
+        this->enabled = enabled;
+        generation++;
+    };
+
+    bool isEnabled()
+    {
+        return enabled;
+    };
+
+    // fills the layer in every update, NULL stops that
+    void setSource(DMXuniverseSource * source)
+    {
+        this->source = source;
+    };
+
+    DMXuniverseSource * getSource()
+    {
+        return source;
+    };
+
+    // changes whenever the merge has to be worked out again
+    unsigned int getGeneration()
+    {
+        return generation;
+    };
+
+    std::map<unsigned int, DMXuniverse*> universes;
+
+protected:
+
+    DMXmergeMode mode;
+    unsigned char priority;
+    bool enabled;
+    DMXuniverseSource * source;
+    unsigned int generation;
+
+};
+
+// Merges a stack of layers into output universes. Only the slot range the
+// layers changed since the last merge is worked out again, by running each
+// layer over it once in priority order: every pass is a branch free loop
+// over bytes that the compiler vectorises. The order, and which layers take
+// part in which universe, is only rebuilt when a layer changes.
+
+class DMXmerger
+{
+public:
+
+    struct Input
+    {
+        DMXlayer * layer;
+        DMXuniverse * universe;
+        unsigned char priority;
+        bool ltp;
+    };
+
+    struct MergedUniverse
+    {
+        MergedUniverse(unsigned int number) : universe(number), live(false), heldByDisabled(false)
+        {
+            memset(priority, 0, MAX_DMX_CHANNELS);
+        };
+        DMXuniverse universe;
+        // whether anything drives the universe: a slot set in an enabled
+        // layer, or a disabled layer blacking it out. Others aren't output.
+        bool live;
+        bool heldByDisabled;
+        // 1 + the priority of the layer a slot came from, 0 for no layer
+        unsigned char priority[MAX_DMX_CHANNELS];
+        std::vector<Input> inputs;
+    };
+
+    DMXmerger()
+    {
+        merges = 0;
+    };
+
+    ~DMXmerger()
+    {
+        for(std::map<unsigned int, MergedUniverse*>::iterator it = universes.begin(); it != universes.end(); it++)
+        {
+            delete it->second;
+        }
+    };
+
+    // merges what changed in layers and cleans them. True if any output
+    // universe changed.
+    bool merge(const std::vector<DMXlayer*> & layers)
+    {
+        merges++;
+        bool rebuild = layers.size() != generations.size();
+        for(size_t l = 0; l < layers.size() && !rebuild; l++)
+        {
+            rebuild = generations[l].first != layers[l] || generations[l].second != layers[l]->getGeneration();
+        }
+        if(rebuild)
+        {
+            rebuildInputs(layers);
+        }
+        bool changed = rebuild;
+        for(std::map<unsigned int, MergedUniverse*>::iterator it = universes.begin(); it != universes.end(); it++)
+        {
+            MergedUniverse & m = *it->second;
+            unsigned int begin = MAX_DMX_CHANNELS;
+            unsigned int end = 0;
+            for(size_t i = 0; i < m.inputs.size(); i++)
+            {
+                DMXuniverse * u = m.inputs[i].universe;
+                if(u->isDirty())
+                {
+                    begin = std::min(begin, u->dirtyBegin);
+                    end = std::max(end, u->dirtyEnd);
+                    u->changedAt = merges;
+                }
+            }
+            // a layer that moved in the order can change any of the slots
+            if(sortInputs(m) || rebuild)
+            {
+                begin = 0;
+                end = MAX_DMX_CHANNELS;
+            }
+            if(begin < end)
+            {
+                mergeRange(m, begin, end);
+                m.live = m.heldByDisabled || isSet(m);
+                changed = true;
+            }
+        }
+        for(size_t l = 0; l < layers.size(); l++)
+        {
+            for(std::map<unsigned int, DMXuniverse*>::iterator it = layers[l]->universes.begin(); it != layers[l]->universes.end(); it++)
+            {
+                it->second->clean();
+            }
+        }
+        return changed;
+    };
+
+    std::map<unsigned int, MergedUniverse*> universes;
+
+protected:
+
+    void rebuildInputs(const std::vector<DMXlayer*> & layers)
+    {
+        generations.resize(layers.size());
+        for(std::map<unsigned int, MergedUniverse*>::iterator it = universes.begin(); it != universes.end(); it++)
+        {
+            it->second->inputs.clear();
+            it->second->heldByDisabled = false;
+        }
+        for(size_t l = 0; l < layers.size(); l++)
+        {
+            DMXlayer * layer = layers[l];
+            generations[l] = std::make_pair(layer, layer->getGeneration());
+            for(std::map<unsigned int, DMXuniverse*>::iterator it = layer->universes.begin(); it != layer->universes.end(); it++)
+            {
+                // universes of a disabled layer stay in the output, blacked out
+                std::map<unsigned int, MergedUniverse*>::iterator m = universes.find(it->first);
+                if(m == universes.end())
+                {
+                    m = universes.insert(std::make_pair(it->first, new MergedUniverse(it->first))).first;
+                }
+                if(!layer->isEnabled())
+                {
+                    m->second->heldByDisabled = true;
+                    continue;
+                }
+                Input input;
+                input.layer = layer;
+                input.universe = it->second;
+                input.priority = layer->getPriority() + 1;
+                input.ltp = layer->getMode() == DMXlayer::DMX_MERGE_LTP;
+                m->second->inputs.push_back(input);
+            }
+        }
+        for(std::map<unsigned int, MergedUniverse*>::iterator it = universes.begin(); it != universes.end(); it++)
+        {
+            for(size_t i = 0; i < it->second->inputs.size(); i++)
+            {
+                it->second->inputs[i].universe->shared = it->second->inputs.size() > 1;
+            }
+        }
+    };
+
+    // lowest priority first, at equal priority in the order they changed,
+    // so an LTP layer only takes slots from layers that changed before it
+    // and an HTP layer that changed after it merges with what it set.
+    // HTP before LTP when they changed in the same merge. Stable, true if
+    // the order changed.
+    static bool inputBefore(const Input & a, const Input & b)
+    {
+        if(a.priority != b.priority)
+        {
+            return a.priority < b.priority;
+        }
+        if(a.universe->changedAt != b.universe->changedAt)
+        {
+            return a.universe->changedAt < b.universe->changedAt;
+        }
+        return !a.ltp && b.ltp;
+    };
+
+    static bool sortInputs(MergedUniverse & m)
+    {
+        bool moved = false;
+        for(size_t i = 1; i < m.inputs.size(); i++)
+        {
+            for(size_t j = i; j > 0 && inputBefore(m.inputs[j], m.inputs[j-1]); j--)
+            {
+                std::swap(m.inputs[j], m.inputs[j-1]);
+                moved = true;
+            }
+        }
+        return moved;
+    };
+
+    // whether any input sets a slot of the universe
+    static bool isSet(const MergedUniverse & m)
+    {
+        for(size_t i = 0; i < m.inputs.size(); i++)
+        {
+            const unsigned char * touched = m.inputs[i].universe->touched;
+            unsigned char any = 0;
+            for(int s = 0; s < MAX_DMX_CHANNELS; s++)
+            {
+                any |= touched[s];
+            }
+            if(any)
+            {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    void mergeRange(MergedUniverse & m, unsigned int begin, unsigned int end)
+    {
+        unsigned char * level = m.universe.slots + begin;
+        unsigned char * priority = m.priority + begin;
+        unsigned int n = end - begin;
+        memset(level, 0, n);
+        memset(priority, 0, n);
+        for(size_t i = 0; i < m.inputs.size(); i++)
+        {
+            const unsigned char * value = m.inputs[i].universe->slots + begin;
+            const unsigned char * touched = m.inputs[i].universe->touched + begin;
+            unsigned char p = m.inputs[i].priority;
+            if(m.inputs[i].ltp)
+            {
+                for(unsigned int s = 0; s < n; s++)
+                {
+                    level[s] = (value[s] & touched[s]) | (level[s] & ~touched[s]);
+                    priority[s] = (p & touched[s]) | (priority[s] & ~touched[s]);
+                }
+            }
+            else
+            {
+                // inputs come in rising priority, so a higher one takes the
+                // slot and an equal one only a higher level
+                for(unsigned int s = 0; s < n; s++)
+                {
+                    unsigned char take = touched[s] & (p > priority[s] || value[s] > level[s] ? 0xff : 0);
+                    level[s] = (value[s] & take) | (level[s] & ~take);
+                    priority[s] = (p & touched[s]) | (priority[s] & ~touched[s]);
+                }
+            }
+        }
+        m.universe.markDirty(begin, end);
+    };
+
+    unsigned long long merges;
+    std::vector<std::pair<DMXlayer*, unsigned int> > generations;
+
+};
@@ -0,0 +1,129 @@
+//
+//  DMXoscTransport.h
+//  ofxOlaShaderLight
+//
+//  Sends universes over OSC with ofxOsc, e.g. to olad's OSC plugin.
+//
+
+#pragma once
+
+#include "ofMain.h"
+#include "ofxOsc.h"
+#include "DMXoutput.h"
+
+class DMXoscTransport : public DMXtransport
+{
+public:
+
+    enum sendModeType {
+        // a 512 byte blob per changed universe, as olad's OSC plugin expects
+        OSC_SEND_UNIVERSE_BLOB,
+        // a bundle of (channel, value) messages for receivers without blob support
+        OSC_SEND_CHANNEL_BUNDLE
+    };
+
+    DMXoscTransport(std::string host = "localhost", int port = 7770)
+    {
+        this->host = host;
+        this->port = port;
+        sendMode = OSC_SEND_UNIVERSE_BLOB;
+        bundleBytes = BUNDLE_HEADER_BYTES;
+    };
+
+    bool setup()
+    {
+        sender.setup(host, port);
+        return true;
+    };
+
+    void setSendMode(sendModeType m)
+    {
+        sendMode = m;
+    };
+
+    void sendUniverse(unsigned int number, const unsigned char * slots, const unsigned char * previous)
+    {
+        // message objects are reused from frame to frame
+        std::map<unsigned int, Universe>::iterator it = universes.find(number);
+        if(it == universes.end())
+        {
+            it = universes.insert(std::make_pair(number, Universe())).first;
+            it->second.address = "/dmx/universe/" + ofToString(number);
+            // size prefix, address and type tags padded to 4 bytes, two ints
+            it->second.channelMessageBytes = 4 + (it->second.address.size() + 4) / 4 * 4 + 4 + 8;
+        }
+        Universe & u = it->second;
+
+        if(sendMode == OSC_SEND_UNIVERSE_BLOB)
+        {
+            u.blob.set((const char*) slots, MAX_DMX_CHANNELS);
+            u.message.clear();
+            u.message.setAddress(u.address);
+            u.message.addBlobArg(u.blob);
+            sender.sendMessage(u.message);
+        }
+        else
+        {
+            for(int i = 0; i < MAX_DMX_CHANNELS; i++)
+            {
+                if(previous == NULL || previous[i] != slots[i])
+                {
+                    // a full universe is 16 KB of messages, sent as several
+                    // bundles that each fit a datagram
+                    if(bundleBytes + u.channelMessageBytes > MAX_BUNDLE_BYTES)
+                    {
+                        sendBundle();
+                    }
+                    u.message.clear();
+                    u.message.setAddress(u.address);
+                    u.message.addIntArg(i+1);
+                    u.message.addIntArg(slots[i]);
+                    bundle.addMessage(u.message);
+                    bundleBytes += u.channelMessageBytes;
+                }
+            }
+        }
+    };
+
+    void flush()
+    {
+        sendBundle();
+    };
+
+    ofxOscSender sender;
+
+protected:
+
+    enum {
+        // stays in one Ethernet frame, well inside ofxOsc's send buffer
+        MAX_BUNDLE_BYTES = 1400,
+        // "#bundle" and the time tag
+        BUNDLE_HEADER_BYTES = 16
+    };
+
+    void sendBundle()
+    {
+        if(bundle.getMessageCount() > 0)
+        {
+            sender.sendBundle(bundle);
+            bundle.clear();
+        }
+        bundleBytes = BUNDLE_HEADER_BYTES;
+    };
+
+    struct Universe
+    {
+        std::string address;
+        unsigned int channelMessageBytes;
+        ofxOscMessage message;
+        ofBuffer blob;
+    };
+
+    std::string host;
+    int port;
+    sendModeType sendMode;
+    std::map<unsigned int, Universe> universes;
+    ofxOscBundle bundle;
+    unsigned int bundleBytes;
+
+};
@@ -0,0 +1,449 @@
+//
+//  DMXoutput.h
+//  ofxOlaShaderLight
+//
+//  Transports and the output scheduler that drives them, independent of
+//  openFrameworks. The OSC transport lives in DMXoscTransport.h.
+//
+
+#pragma once
+
+#include <map>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <chrono>
+
+#include <iostream>
+
+#include "DMXfade.h"
+
+#ifdef USE_OLA_LIB_AND_NOT_OSC
+#include <ola/DmxBuffer.h>
+#include <ola/Logging.h>
+#include <ola/StreamingClient.h>
+#include <ola/OlaClientWrapper.h>
+#include <ola/Callback.h>
+#endif
+
+#define MAX_DMX_CHANNELS 512
+
+// Sends whole universes somewhere. Only ever called from one thread at a
+// time, either the app thread or the DMXoutput thread.
+
+class DMXtransport
+{
+public:
+
+    virtual ~DMXtransport() {};
+
+    virtual bool setup() = 0;
+
+    // slots holds MAX_DMX_CHANNELS values, previous is what was last sent
+    // for this universe or NULL when the receiver should get everything
+    virtual void sendUniverse(unsigned int number, const unsigned char * slots, const unsigned char * previous) = 0;
+
+    // called once after the universes of a frame have been sent
+    virtual void flush() {};
+
+    // sends timecode where the transport can, called before the frame it
+    // belongs to
+    virtual void sendTimecode(const DMXtimecode &) {};
+
+};
+
+// Sees every universe the output sends, changed or kept alive, on the
+// sending side, after fades have been applied. A newly set tap is handed
+// every universe of the next frame. Must return quickly.
+
+class DMXoutputTap
+{
+public:
+
+    virtual ~DMXoutputTap() {};
+
+    virtual void universeSent(unsigned int number, const unsigned char * slots) = 0;
+
+};
+
+#ifdef USE_OLA_LIB_AND_NOT_OSC
+
+class DMXolaTransport : public DMXtransport
+{
+public:
+
+    DMXolaTransport()
+    {
+        timecodeClient = NULL;
+        timecodeFailed = false;
+    };
+
+    ~DMXolaTransport()
+    {
+        delete timecodeClient;
+    };
+
+    bool setup()
+    {
+        ola::InitLogging(ola::OLA_LOG_WARN, ola::OLA_LOG_STDERR);
+        // Setup the client, this connects to the server
+        if (!client.Setup())
+        {
+            std::cerr << "OLA Setup failed" << std::endl;
+            return false;
+        }
+        return true;
+    };
+
+    void sendUniverse(unsigned int number, const unsigned char * slots, const unsigned char * /* previous */)
+    {
+        // one DmxBuffer per universe, allocated on first send
+        ola::DmxBuffer & buffer = buffers[number];
+        buffer.Set(slots, MAX_DMX_CHANNELS);
+        if (!client.SendDmx(number, buffer))
+        {
+            std::cout << "Send DMX failed" << std::endl;
+        }
+    };
+
+    // the streaming client can't send timecode, so a full client is
+    // connected for it the first time there is some to send
+    void sendTimecode(const DMXtimecode & timecode)
+    {
+        if(timecodeFailed)
+        {
+            return;
+        }
+        if(timecodeClient == NULL)
+        {
+            timecodeClient = new ola::client::OlaClientWrapper();
+            if(!timecodeClient->Setup())
+            {
+                std::cerr << "OLA timecode client setup failed" << std::endl;
+                delete timecodeClient;
+                timecodeClient = NULL;
+                timecodeFailed = true;
+                return;
+            }
+        }
+        timecodeClient->GetClient()->SendTimeCode(timecode.toOla(), ola::NewSingleCallback(&DMXolaTransport::timecodeSent));
+        // deliver the request and any replies without blocking
+        timecodeClient->GetSelectServer()->RunOnce(0, 0);
+    };
+
+    ola::StreamingClient client;
+
+protected:
+
+    static void timecodeSent(const ola::client::Result & result)
+    {
+        if(!result.Success())
+        {
+            std::cerr << "Send timecode failed: " << result.Error() << std::endl;
+        }
+    };
+
+    std::map<unsigned int, ola::DmxBuffer> buffers;
+    ola::client::OlaClientWrapper * timecodeClient;
+    bool timecodeFailed;
+
+};
+
+#endif // USE_OLA_LIB_AND_NOT_OSC
+
+// A snapshot of every universe, MAX_DMX_CHANNELS slots per universe, and
+// the channel fades the sending side applies on top of it.
+
+class DMXframe
+{
+public:
+
+    void resize(size_t numUniverses)
+    {
+        numbers.resize(numUniverses);
+        slots.resize(numUniverses * MAX_DMX_CHANNELS);
+    };
+
+    size_t size() const
+    {
+        return numbers.size();
+    };
+
+    unsigned char * getSlots(size_t i)
+    {
+        return &slots[i * MAX_DMX_CHANNELS];
+    };
+
+    const unsigned char * getSlots(size_t i) const
+    {
+        return &slots[i * MAX_DMX_CHANNELS];
+    };
+
+    std::vector<unsigned int> numbers;
+    std::vector<unsigned char> slots;
+    DMXchannelFades fades;
+
+};
+
+// Owns a transport and feeds it frames, either inline from update() or
+// from its own thread at a fixed rate. The app thread fills the back frame
+// and publishes it; the sending side always picks up the newest published
+// frame. Frames are handed over through a triple buffer with one atomic
+// index, so neither side ever waits for the other.
+// A universe is only sent when it differs from what was last sent, or when
+// the keep-alive interval has passed.
+// With a running DMXclock the thread sends on the show time grid, at whole
+// multiples of the frame period, and fades follow show time. Timecode is
+// generated from the clock whenever its frame changes, so for every
+// timecode frame to go out the output rate must be a multiple of the
+// timecode rate.
+
+class DMXoutput
+{
+public:
+
+    DMXoutput(DMXtransport * transport)
+    {
+        this->transport = transport;
+        back = 0;
+        middle = 1;
+        front = 2;
+        keepAliveMillis = 1000;
+        framesPerSecond = 44;
+        running = false;
+        tap = NULL;
+        tapEverything = false;
+        clock = NULL;
+        timecodeGeneration = false;
+        timecodeType = DMXtimecode::DMX_TIMECODE_EBU;
+        lastTimecodeFrame = ~0ull;
+    };
+
+    ~DMXoutput()
+    {
+        stopThread();
+    };
+
+    bool setup()
+    {
+        return transport->setup();
+    };
+
+    DMXtransport * getTransport()
+    {
+        return transport;
+    };
+
+    // app thread: fill this, then publish()
+    DMXframe & getBackFrame()
+    {
+        return frames[back];
+    };
+
+    void publish()
+    {
+        back = middle.exchange(back | NEW_FRAME) & FRAME_INDEX;
+    };
+
+    // how often an unchanged universe is resent, 0 sends every frame
+    void setKeepAliveInterval(unsigned int millis)
+    {
+        keepAliveMillis = millis;
+    };
+
+    unsigned int getKeepAliveInterval()
+    {
+        return keepAliveMillis;
+    };
+
+    // NULL removes the tap; a removed tap may still be called by a send
+    // that is under way, so it must outlive that
+    void setTap(DMXoutputTap * tap)
+    {
+        this->tap = tap;
+        tapEverything = tap != NULL;
+    };
+
+    // NULL goes back to the steady clock; the clock must outlive its use
+    void setClock(DMXclock * clock)
+    {
+        this->clock = clock;
+    };
+
+    // sends the clock's timecode of type along with the frames
+    void setTimecodeGeneration(bool generate, DMXtimecode::DMXtimecodeType type = DMXtimecode::DMX_TIMECODE_EBU)
+    {
+        timecodeType = type;
+        timecodeGeneration = generate;
+    };
+
+    bool isGeneratingTimecode()
+    {
+        return timecodeGeneration;
+    };
+
+    void startThread(float framesPerSecond = 44)
+    {
+        stopThread();
+        this->framesPerSecond = framesPerSecond;
+        running = true;
+        thread = std::thread(&DMXoutput::threadedFunction, this);
+    };
+
+    void stopThread()
+    {
+        if(running)
+        {
+            running = false;
+            thread.join();
+        }
+    };
+
+    bool isThreadRunning()
+    {
+        return running;
+    };
+
+    // sending side: send the newest published frame
+    void sendLatest()
+    {
+        if(middle.load() & NEW_FRAME)
+        {
+            front = middle.exchange(front) & FRAME_INDEX;
+        }
+
+        // the front frame belongs to the sending side, fades are written into it
+        DMXframe & frame = frames[front];
+        DMXclock * c = clock;
+        unsigned long long showMicros = c != NULL ? c->getMicros() : DMXmicros();
+        if(frame.fades.size() > 0 && frame.size() > 0)
+        {
+            frame.fades.apply(showMicros, frame.getSlots(0), MAX_DMX_CHANNELS);
+        }
+        if(c != NULL && timecodeGeneration)
+        {
+            DMXtimecode timecode = DMXtimecode::fromMicros(showMicros, timecodeType);
+            unsigned long long frameNumber = timecode.getFrameNumber();
+            if(frameNumber != lastTimecodeFrame)
+            {
+                transport->sendTimecode(timecode);
+                lastTimecodeFrame = frameNumber;
+            }
+        }
+        // keep-alive runs on the steady clock, a stopped show still refreshes
+        unsigned long long now = DMXmicros() / 1000;
+        bool everything = tapEverything.exchange(false);
+        DMXoutputTap * t = tap;
+        for(size_t i = 0; i < frame.size(); i++)
+        {
+            const unsigned char * slots = frame.getSlots(i);
+            SentUniverse & sent = lastSent[frame.numbers[i]];
+            bool changed = !sent.valid || memcmp(slots, sent.slots, MAX_DMX_CHANNELS) != 0;
+            bool expired = now - sent.millis >= keepAliveMillis;
+            if(changed || expired)
+            {
+                transport->sendUniverse(frame.numbers[i], slots, (changed && sent.valid) ? sent.slots : NULL);
+                memcpy(sent.slots, slots, MAX_DMX_CHANNELS);
+                sent.valid = true;
+                sent.millis = now;
+            }
+            if((changed || expired || everything) && t != NULL)
+            {
+                t->universeSent(frame.numbers[i], slots);
+            }
+        }
+        if(lastSent.size() > frame.size())
+        {
+            forgetUniverses(frame);
+        }
+        transport->flush();
+    };
+
+protected:
+
+    enum {
+        FRAME_INDEX = 3,
+        NEW_FRAME = 4
+    };
+
+    struct SentUniverse
+    {
+        SentUniverse() : valid(false), millis(0) {};
+        bool valid;
+        unsigned long long millis;
+        unsigned char slots[MAX_DMX_CHANNELS];
+    };
+
+    // universes that left the frame are sent complete if they come back
+    void forgetUniverses(const DMXframe & frame)
+    {
+        for(std::map<unsigned int, SentUniverse>::iterator it = lastSent.begin(); it != lastSent.end();)
+        {
+            if(std::find(frame.numbers.begin(), frame.numbers.end(), it->first) == frame.numbers.end())
+            {
+                lastSent.erase(it++);
+            }
+            else
+            {
+                it++;
+            }
+        }
+    };
+
+    void threadedFunction()
+    {
+        std::chrono::steady_clock::duration period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
+        unsigned long long periodMicros = std::max(1ull, (unsigned long long) (1000000.0 / framesPerSecond));
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+        while(running)
+        {
+            sendLatest();
+            DMXclock * c = clock;
+            if(c != NULL && c->isRunning())
+            {
+                // wake at the next multiple of the period in show time, so
+                // frames line up with the show whatever it was located to
+                unsigned long long show = c->getMicros();
+                unsigned long long nextShow = (show / periodMicros + 1) * periodMicros;
+                next = std::chrono::steady_clock::now() + std::chrono::microseconds(nextShow - show);
+            }
+            else
+            {
+                next += period;
+                std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                if(next < now)
+                {
+                    // fell behind, don't try to catch up with a burst
+                    next = now;
+                }
+            }
+            std::this_thread::sleep_until(next);
+        }
+    };
+
+    DMXtransport * transport;
+
+    DMXframe frames[3];
+    int back;
+    std::atomic<int> middle;
+    int front;
+
+    std::map<unsigned int, SentUniverse> lastSent;
+    std::atomic<unsigned int> keepAliveMillis;
+    std::atomic<DMXoutputTap*> tap;
+    // the next frame goes to the tap whole, unchanged universes included
+    std::atomic<bool> tapEverything;
+
+    std::atomic<DMXclock*> clock;
+    std::atomic<bool> timecodeGeneration;
+    std::atomic<DMXtimecode::DMXtimecodeType> timecodeType;
+    unsigned long long lastTimecodeFrame;
+
+    float framesPerSecond;
+    std::atomic<bool> running;
+    std::thread thread;
+
+};
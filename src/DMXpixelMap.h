@@ -0,0 +1,316 @@
+//
+//  DMXpixelMap.h
+//  ofxOlaShaderLight
+//
+//  Samples images at fixture positions, independent of openFrameworks.
+//
+
+#pragma once
+
+#include <cmath>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include "DMXpixels.h"
+
+// A layout of sample points in an image, one per fixture or pixel, in
+// coordinates from 0 to 1 across the image. For every point the byte
+// offsets of its four neighbouring pixels and their bilinear weights are
+// worked out once, when the layout or the image size changes; a frame
+// then only gathers and weighs bytes into one red, green and blue array,
+// split over a few threads.
+
+class DMXpixelMap
+{
+public:
+
+    DMXpixelMap()
+    {
+        threads = std::max(1u, std::min(std::thread::hardware_concurrency(), 8u));
+        layoutChanged = true;
+        width = 0;
+        height = 0;
+        channels = 0;
+        pixels = NULL;
+        job = 0;
+        pending = 0;
+        quit = false;
+    };
+
+    ~DMXpixelMap()
+    {
+        stopWorkers();
+    };
+
+    // returns the point's index, which is where its colour lands
+    size_t addPoint(float x, float y)
+    {
+        pointX.push_back(x);
+        pointY.push_back(y);
+        layoutChanged = true;
+        return size() - 1;
+    };
+
+    void setPoint(size_t i, float x, float y)
+    {
+        pointX[i] = x;
+        pointY[i] = y;
+        layoutChanged = true;
+    };
+
+    void clear()
+    {
+        pointX.clear();
+        pointY.clear();
+        layoutChanged = true;
+    };
+
+    size_t size() const
+    {
+        return pointX.size();
+    };
+
+    // threads sampling a frame, the calling thread included
+    void setThreads(unsigned int threads)
+    {
+        stopWorkers();
+        this->threads = std::max(1u, threads);
+    };
+
+    // samples an 8 bit image of 1 (grey), 3 (RGB) or 4 (RGBA) channels,
+    // rows packed one after another
+    void sample(const unsigned char * pixels, unsigned int width, unsigned int height, unsigned int channels)
+    {
+        if(pixels == NULL || width == 0 || height == 0 || channels == 0)
+        {
+            return;
+        }
+        if(layoutChanged || width != this->width || height != this->height || channels != this->channels)
+        {
+            compile(width, height, channels);
+        }
+        this->pixels = pixels;
+        size_t n = size();
+        if(n == 0)
+        {
+            return;
+        }
+        if(threads == 1 || n < MIN_POINTS_PER_THREAD * 2)
+        {
+            sampleRange(0, n);
+            return;
+        }
+        if(workers.empty())
+        {
+            startWorkers();
+        }
+        std::unique_lock<std::mutex> lock(mutex);
+        job++;
+        pending = workers.size();
+        wake.notify_all();
+        lock.unlock();
+        sampleRange(0, n / threads);
+        lock.lock();
+        done.wait(lock, [this]{ return pending == 0; });
+    };
+
+    // the colours of the last sample(), 0 to 1, indexed by point
+    const float * getRed() const
+    {
+        return red.empty() ? NULL : &red[0];
+    };
+
+    const float * getGreen() const
+    {
+        return green.empty() ? NULL : &green[0];
+    };
+
+    const float * getBlue() const
+    {
+        return blue.empty() ? NULL : &blue[0];
+    };
+
+    // writes point i to pixel first + i of group. RGBW pixels get their
+    // white taken out of red, green and blue.
+    void writeTo(DMXpixelGroup & group, unsigned int first = 0) const
+    {
+        if(first >= group.size() || red.empty())
+        {
+            return;
+        }
+        size_t n = std::min(size(), (size_t) (group.size() - first));
+        unsigned char * out = group.getData() + (size_t) first * group.getBytesPerPixel();
+        if(group.getFormat() == DMXpixelGroup::DMX_PIXEL_RGBW)
+        {
+            for(size_t i = 0; i < n; i++)
+            {
+                float r = red[i], g = green[i], b = blue[i];
+                float w = r < g ? r : g;
+                w = w < b ? w : b;
+                out[i*4] = (r - w) * 255.f + 0.5f;
+                out[i*4+1] = (g - w) * 255.f + 0.5f;
+                out[i*4+2] = (b - w) * 255.f + 0.5f;
+                out[i*4+3] = w * 255.f + 0.5f;
+            }
+        }
+        else
+        {
+            for(size_t i = 0; i < n; i++)
+            {
+                out[i*3] = red[i] * 255.f + 0.5f;
+                out[i*3+1] = green[i] * 255.f + 0.5f;
+                out[i*3+2] = blue[i] * 255.f + 0.5f;
+            }
+        }
+        group.markChanged();
+    };
+
+protected:
+
+    enum {
+        MIN_POINTS_PER_THREAD = 2048
+    };
+
+    // points sit on pixel centres and clamp to the image's edge pixels
+    void compile(unsigned int width, unsigned int height, unsigned int channels)
+    {
+        this->width = width;
+        this->height = height;
+        this->channels = channels;
+        size_t n = size();
+        for(int k = 0; k < 4; k++)
+        {
+            offset[k].resize(n);
+            weight[k].resize(n);
+        }
+        red.resize(n);
+        green.resize(n);
+        blue.resize(n);
+        unsigned int stride = width * channels;
+        for(size_t i = 0; i < n; i++)
+        {
+            float x = std::min(std::max(pointX[i] * width - 0.5f, 0.f), (float) (width - 1));
+            float y = std::min(std::max(pointY[i] * height - 0.5f, 0.f), (float) (height - 1));
+            unsigned int x0 = (unsigned int) x;
+            unsigned int y0 = (unsigned int) y;
+            unsigned int right = x0 + 1 < width ? channels : 0;
+            unsigned int down = y0 + 1 < height ? stride : 0;
+            float fx = x - x0;
+            float fy = y - y0;
+            unsigned int topLeft = y0 * stride + x0 * channels;
+            offset[0][i] = topLeft;
+            offset[1][i] = topLeft + right;
+            offset[2][i] = topLeft + down;
+            offset[3][i] = topLeft + down + right;
+            // scaled to give colours from 0 to 1
+            weight[0][i] = (1.f - fx) * (1.f - fy) / 255.f;
+            weight[1][i] = fx * (1.f - fy) / 255.f;
+            weight[2][i] = (1.f - fx) * fy / 255.f;
+            weight[3][i] = fx * fy / 255.f;
+        }
+        layoutChanged = false;
+    };
+
+    void sampleRange(size_t begin, size_t end)
+    {
+        const unsigned char * p = pixels;
+        // grey images give all three colours from their one channel
+        unsigned int gc = channels >= 3 ? 1 : 0;
+        unsigned int bc = channels >= 3 ? 2 : 0;
+        const unsigned int * o0 = &offset[0][0];
+        const unsigned int * o1 = &offset[1][0];
+        const unsigned int * o2 = &offset[2][0];
+        const unsigned int * o3 = &offset[3][0];
+        const float * w0 = &weight[0][0];
+        const float * w1 = &weight[1][0];
+        const float * w2 = &weight[2][0];
+        const float * w3 = &weight[3][0];
+        float * r = &red[0];
+        float * g = &green[0];
+        float * b = &blue[0];
+        for(size_t i = begin; i < end; i++)
+        {
+            const unsigned char * a = p + o0[i];
+            const unsigned char * c = p + o1[i];
+            const unsigned char * d = p + o2[i];
+            const unsigned char * e = p + o3[i];
+            r[i] = w0[i] * a[0] + w1[i] * c[0] + w2[i] * d[0] + w3[i] * e[0];
+            g[i] = w0[i] * a[gc] + w1[i] * c[gc] + w2[i] * d[gc] + w3[i] * e[gc];
+            b[i] = w0[i] * a[bc] + w1[i] * c[bc] + w2[i] * d[bc] + w3[i] * e[bc];
+        }
+    };
+
+    // worker k samples part k of threads, the calling thread part 0.
+    // Restarted workers wait for the job after the current one.
+    void startWorkers()
+    {
+        quit = false;
+        for(unsigned int k = 1; k < threads; k++)
+        {
+            workers.push_back(std::thread(&DMXpixelMap::work, this, k, job));
+        }
+    };
+
+    void stopWorkers()
+    {
+        if(workers.empty())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            quit = true;
+        }
+        wake.notify_all();
+        for(size_t k = 0; k < workers.size(); k++)
+        {
+            workers[k].join();
+        }
+        workers.clear();
+    };
+
+    void work(unsigned int part, unsigned int seen)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while(true)
+        {
+            wake.wait(lock, [this, seen]{ return quit || job != seen; });
+            if(quit)
+            {
+                return;
+            }
+            seen = job;
+            lock.unlock();
+            size_t n = size();
+            sampleRange(n * part / threads, n * (part + 1) / threads);
+            lock.lock();
+            if(--pending == 0)
+            {
+                done.notify_one();
+            }
+        }
+    };
+
+    std::vector<float> pointX, pointY;
+    bool layoutChanged;
+
+    // per point, parallel arrays: the offsets of the top left, top right,
+    // bottom left and bottom right neighbours and their weights
+    std::vector<unsigned int> offset[4];
+    std::vector<float> weight[4];
+    unsigned int width, height, channels;
+
+    std::vector<float> red, green, blue;
+
+    const unsigned char * pixels;
+    unsigned int threads;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    unsigned int job;
+    size_t pending;
+    bool quit;
+
+};
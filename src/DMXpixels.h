@@ -0,0 +1,311 @@
+//
+//  DMXpixels.h
+//  ofxOlaShaderLight
+//
+//  Packed pixel data for LED pixel fixtures, independent of openFrameworks.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include "DMXlayer.h"
+
+// A run of pixels stored the way pixel protocols carry them: 3 or 4 bytes
+// a pixel, back to back, so they can be sent or copied without repacking.
+
+class DMXpixelGroup
+{
+public:
+
+    enum DMXpixelFormat
+    {
+        DMX_PIXEL_RGB = 3,
+        DMX_PIXEL_RGBW = 4
+    };
+
+    DMXpixelGroup(unsigned int numPixels = 0, DMXpixelFormat format = DMX_PIXEL_RGB)
+    {
+        this->format = format;
+        generation = 0;
+        resize(numPixels);
+    };
+
+    void resize(unsigned int numPixels)
+    {
+        this->numPixels = numPixels;
+        data.resize(numPixels * format);
+        generation++;
+    };
+
+    unsigned int size() const
+    {
+        return numPixels;
+    };
+
+    unsigned int getBytesPerPixel() const
+    {
+        return format;
+    };
+
+    DMXpixelFormat getFormat() const
+    {
+        return format;
+    };
+
+    // the packed bytes, call markChanged() after writing them
+    unsigned char * getData()
+    {
+        return data.empty() ? NULL : &data[0];
+    };
+
+    const unsigned char * getData() const
+    {
+        return data.empty() ? NULL : &data[0];
+    };
+
+    unsigned int getDataSize() const
+    {
+        return data.size();
+    };
+
+    void setPixel(unsigned int i, unsigned char r, unsigned char g, unsigned char b, unsigned char w = 0)
+    {
+        unsigned char * p = &data[i * format];
+        p[0] = r;
+        p[1] = g;
+        p[2] = b;
+        if(format == DMX_PIXEL_RGBW)
+        {
+            p[3] = w;
+        }
+        generation++;
+    };
+
+    void markChanged()
+    {
+        generation++;
+    };
+
+    // changes with every change of the pixels, so several outputs can
+    // each tell what they haven't sent yet
+    unsigned int getGeneration() const
+    {
+        return generation;
+    };
+
+protected:
+
+    DMXpixelFormat format;
+    unsigned int numPixels;
+    std::vector<unsigned char> data;
+    unsigned int generation;
+
+};
+
+// A pixel strip patched at one DMX start address. Its pixels run on
+// through as many universes as they need, 170 RGB or 128 RGBW pixels to a
+// full universe; a pixel that doesn't fit in what is left of a universe
+// starts the next one, unless pixels are split across universes.
+// The strip is written a universe at a time with DMXuniverse::setSlots(),
+// after putting the pixels in the order the strip is wired in.
+
+class DMXpixelStrip : public DMXpixelGroup
+{
+public:
+
+    // the order the strip takes the colours in, white always comes last
+    enum DMXwiringOrder
+    {
+        DMX_ORDER_RGB,
+        DMX_ORDER_RBG,
+        DMX_ORDER_GRB,
+        DMX_ORDER_GBR,
+        DMX_ORDER_BRG,
+        DMX_ORDER_BGR
+    };
+
+    DMXpixelStrip(unsigned int numPixels = 0, DMXpixelFormat format = DMX_PIXEL_RGB, DMXwiringOrder order = DMX_ORDER_RGB) : DMXpixelGroup(numPixels, format)
+    {
+        this->order = order;
+        startAddress = 0;
+        universe = 0;
+        splitPixels = false;
+        layoutGeneration = 0;
+    };
+
+    // startAddress counts from 1 to 512, 0 unpatches the strip
+    void setAddress(int startAddress, unsigned int universe = 0)
+    {
+        this->startAddress = startAddress;
+        this->universe = universe;
+        layoutGeneration++;
+    };
+
+    int getStartAddress() const
+    {
+        return startAddress;
+    };
+
+    unsigned int getUniverse() const
+    {
+        return universe;
+    };
+
+    // a start address past the universe's last slot patches nothing,
+    // like a fixture channel beyond it
+    bool isPatched() const
+    {
+        return startAddress >= 1 && startAddress <= MAX_DMX_CHANNELS;
+    };
+
+    // fills every universe to its last slot, for controllers that take
+    // a pixel's channels from two universes
+    void setSplitPixels(bool split)
+    {
+        splitPixels = split;
+        layoutGeneration++;
+    };
+
+    void setWiringOrder(DMXwiringOrder order)
+    {
+        this->order = order;
+        markChanged();
+    };
+
+    DMXwiringOrder getWiringOrder() const
+    {
+        return order;
+    };
+
+    // changes when the strip moves to other slots
+    unsigned int getLayoutGeneration() const
+    {
+        return layoutGeneration;
+    };
+
+    // the universes the strip spans from its start universe on
+    unsigned int getUniverseCount() const
+    {
+        if(!isPatched() || numPixels == 0)
+        {
+            return 0;
+        }
+        unsigned int first = MAX_DMX_CHANNELS - (startAddress - 1);
+        unsigned int perUniverse = MAX_DMX_CHANNELS;
+        if(!splitPixels)
+        {
+            first = first / format * format;
+            perUniverse = perUniverse / format * format;
+        }
+        unsigned int size = getDataSize();
+        return size <= first ? 1 : 1 + (size - first + perUniverse - 1) / perUniverse;
+    };
+
+    // writes the pixels to the layer, one copy per universe
+    void write(DMXlayer & layer)
+    {
+        if(!isPatched() || data.empty())
+        {
+            return;
+        }
+        const unsigned char * wired = &data[0];
+        if(order != DMX_ORDER_RGB)
+        {
+            wiring.resize(data.size());
+            reorder(&data[0], &wiring[0]);
+            wired = &wiring[0];
+        }
+        unsigned int size = data.size();
+        unsigned int number = universe;
+        unsigned int slot = startAddress - 1;
+        unsigned int written = 0;
+        while(written < size)
+        {
+            unsigned int room = MAX_DMX_CHANNELS - slot;
+            if(!splitPixels)
+            {
+                room = room / format * format;
+            }
+            unsigned int n = std::min(room, size - written);
+            if(n > 0)
+            {
+                layer.getUniverse(number)->setSlots(wired + written, slot, n);
+                written += n;
+            }
+            number++;
+            slot = 0;
+        }
+    };
+
+protected:
+
+    // out gets the colours of in at the positions R, G and B, fixed at
+    // compile time so the loop vectorises into byte shuffles
+    template<int R, int G, int B, int BPP>
+    static void reorder(const unsigned char * in, unsigned char * out, size_t numPixels)
+    {
+        // a size_t index keeps i * BPP affine for the vectoriser
+        for(size_t i = 0; i < numPixels; i++)
+        {
+            const unsigned char * p = in + i * BPP;
+            unsigned char * q = out + i * BPP;
+            q[0] = p[R];
+            q[1] = p[G];
+            q[2] = p[B];
+            if(BPP == 4)
+            {
+                q[3] = p[3];
+            }
+        }
+    };
+
+    template<int BPP>
+    void reorder(const unsigned char * in, unsigned char * out)
+    {
+        switch(order)
+        {
+            case DMX_ORDER_RBG:
+                reorder<0,2,1,BPP>(in, out, numPixels);
+                break;
+            case DMX_ORDER_GRB:
+                reorder<1,0,2,BPP>(in, out, numPixels);
+                break;
+            case DMX_ORDER_GBR:
+                reorder<1,2,0,BPP>(in, out, numPixels);
+                break;
+            case DMX_ORDER_BRG:
+                reorder<2,0,1,BPP>(in, out, numPixels);
+                break;
+            case DMX_ORDER_BGR:
+                reorder<2,1,0,BPP>(in, out, numPixels);
+                break;
+            default:
+                memcpy(out, in, numPixels * BPP);
+                break;
+        }
+    };
+
+    void reorder(const unsigned char * in, unsigned char * out)
+    {
+        if(format == DMX_PIXEL_RGBW)
+        {
+            reorder<4>(in, out);
+        }
+        else
+        {
+            reorder<3>(in, out);
+        }
+    };
+
+    DMXwiringOrder order;
+    int startAddress;
+    unsigned int universe;
+    bool splitPixels;
+    unsigned int layoutGeneration;
+    // the pixels in wiring order, when that isn't RGB
+    std::vector<unsigned char> wiring;
+
+};
@@ -0,0 +1,490 @@
+//
+//  DMXplayer.h
+//  ofxOlaShaderLight
+//
+//  Plays recordings made by DMXrecorder, independent of openFrameworks.
+//
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+#include <algorithm>
+#include "DMXclock.h"
+#include "DMXlayer.h"
+#include "DMXrecorder.h"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// Memory maps a recording and plays it into a layer's universes as a
+// DMXuniverseSource. Opening the file scans it once for the keyframes of
+// every universe; seeking then finds each universe's last keyframe with a
+// binary search and follows the deltas from there. Playing only decodes the
+// records that are due, into buffers allocated when the file is opened.
+
+class DMXplayer : public DMXuniverseSource
+{
+public:
+
+    DMXplayer()
+    {
+        data = NULL;
+        size = 0;
+        indexedSize = 0;
+        playing = false;
+        loop = false;
+        cursor = 0;
+        position = 0;
+        playStartMicros = 0;
+        playStartPending = false;
+        playStartPosition = 0;
+        startMicros = 0;
+        endMicros = 0;
+        locked = false;
+        lockOffset = 0;
+        targetLayer = NULL;
+    };
+
+    ~DMXplayer()
+    {
+        close();
+    };
+
+    bool open(const std::string & path)
+    {
+        close();
+        if(!map(path))
+        {
+            std::cerr << "DMXplayer: could not open " << path << std::endl;
+            return false;
+        }
+        if(size < DMXrecording::magicSize || memcmp(data, DMXrecording::magic(), DMXrecording::magicSize) != 0)
+        {
+            std::cerr << "DMXplayer: " << path << " is not a recording" << std::endl;
+            close();
+            return false;
+        }
+        if(!index())
+        {
+            std::cerr << "DMXplayer: " << path << " is truncated, playing what is complete" << std::endl;
+        }
+        seek(0);
+        return true;
+    };
+
+    void close()
+    {
+        stop();
+        unmap();
+        universes.clear();
+        universeIndex.clear();
+        targetLayer = NULL;
+        indexedSize = 0;
+        cursor = 0;
+        position = 0;
+        startMicros = 0;
+        endMicros = 0;
+    };
+
+    bool isOpen()
+    {
+        return data != NULL;
+    };
+
+    // starts from the position on the next fillUniverses(), in the time
+    // the engine updates with, steady or show time
+    void play()
+    {
+        playStartPending = true;
+        playStartPosition = position;
+        playing = true;
+    };
+
+    void stop()
+    {
+        playing = false;
+    };
+
+    bool isPlaying()
+    {
+        return playing;
+    };
+
+    void setLoop(bool loop)
+    {
+        this->loop = loop;
+    };
+
+    // follows the time the engine updates with instead of playing on its
+    // own: the recording's start plays at offsetMicros, before that the
+    // first state holds and after its end the last. Locate or chase the
+    // engine's DMXclock to move through the recording.
+    void lockToClock(unsigned long long offsetMicros = 0)
+    {
+        lockOffset = offsetMicros;
+        locked = true;
+    };
+
+    void unlockFromClock()
+    {
+        locked = false;
+    };
+
+    bool isLockedToClock()
+    {
+        return locked;
+    };
+
+    // microseconds from the first record to the last
+    unsigned long long getDuration()
+    {
+        return endMicros - startMicros;
+    };
+
+    unsigned long long getPosition()
+    {
+        return position;
+    };
+
+    // when the first record was recorded, in microseconds since the epoch
+    unsigned long long getStartMicros()
+    {
+        return startMicros;
+    };
+
+    // sets every universe to what it was at position microseconds into the
+    // recording
+    void seek(unsigned long long position)
+    {
+        this->position = std::min(position, getDuration());
+        unsigned long long time = startMicros + this->position;
+
+        // every universe restarts from its last keyframe at or before time,
+        // the scan starts at the earliest of those
+        size_t scanFrom = size;
+        for(size_t u = 0; u < universes.size(); u++)
+        {
+            PlayedUniverse & universe = universes[u];
+            std::vector<Keyframe> & keyframes = universe.keyframes;
+            std::vector<Keyframe>::iterator it = std::upper_bound(keyframes.begin(), keyframes.end(), time, Keyframe::before);
+            memset(universe.slots, 0, MAX_DMX_CHANNELS);
+            universe.changed = true;
+            if(it == keyframes.begin())
+            {
+                // nothing recorded for this universe yet
+                universe.resumeAt = size;
+                continue;
+            }
+            universe.resumeAt = (it-1)->offset;
+            scanFrom = std::min(scanFrom, universe.resumeAt);
+        }
+        cursor = scanFrom;
+        while(cursor < indexedSize)
+        {
+            Record r = readRecord(cursor);
+            if(r.micros > time)
+            {
+                break;
+            }
+            PlayedUniverse & universe = universes[universeIndex[r.universe]];
+            if(cursor >= universe.resumeAt)
+            {
+                apply(r, universe);
+            }
+            cursor = r.next;
+        }
+        if(playing)
+        {
+            play();
+        }
+    };
+
+    // applies the records due by position microseconds into the recording
+    void advance(unsigned long long position)
+    {
+        if(position < this->position)
+        {
+            seek(position);
+            return;
+        }
+        this->position = std::min(position, getDuration());
+        unsigned long long time = startMicros + this->position;
+        while(cursor < indexedSize)
+        {
+            Record r = readRecord(cursor);
+            if(r.micros > time)
+            {
+                break;
+            }
+            apply(r, universes[universeIndex[r.universe]]);
+            cursor = r.next;
+        }
+    };
+
+    void invalidate()
+    {
+        targetLayer = NULL;
+    };
+
+    void fillUniverses(DMXlayer & layer, unsigned long long micros)
+    {
+        if(&layer != targetLayer)
+        {
+            for(size_t u = 0; u < universes.size(); u++)
+            {
+                universes[u].target = NULL;
+                universes[u].changed = true;
+            }
+            targetLayer = &layer;
+        }
+        if(locked)
+        {
+            // advance() seeks when the clock went back
+            advance(micros > lockOffset ? micros - lockOffset : 0);
+        }
+        else if(playing)
+        {
+            if(playStartPending || micros < playStartMicros)
+            {
+                // started, or the clock went back: play on from here
+                playStartMicros = micros;
+                playStartPosition = position;
+                playStartPending = false;
+            }
+            unsigned long long next = playStartPosition + (micros - playStartMicros);
+            if(next > getDuration())
+            {
+                if(loop && getDuration() > 0)
+                {
+                    seek(0);
+                    playStartMicros = micros;
+                    playStartPosition = 0;
+                    next = 0;
+                }
+                else
+                {
+                    playing = false;
+                    next = getDuration();
+                }
+            }
+            advance(next);
+        }
+        for(size_t u = 0; u < universes.size(); u++)
+        {
+            PlayedUniverse & universe = universes[u];
+            if(universe.changed)
+            {
+                // resolved once, so playing doesn't look up or allocate
+                if(universe.target == NULL)
+                {
+                    universe.target = layer.getUniverse(universe.number);
+                }
+                universe.target->setSlots(universe.slots);
+                universe.changed = false;
+            }
+        }
+    };
+
+protected:
+
+    struct Keyframe
+    {
+        unsigned long long micros;
+        size_t offset;
+
+        static bool before(unsigned long long micros, const Keyframe & k)
+        {
+            return micros < k.micros;
+        };
+    };
+
+    struct PlayedUniverse
+    {
+        PlayedUniverse(unsigned int number) : number(number), target(NULL), changed(false), resumeAt(0)
+        {
+            memset(slots, 0, MAX_DMX_CHANNELS);
+        };
+        unsigned int number;
+        DMXuniverse * target;
+        bool changed;
+        size_t resumeAt;
+        std::vector<Keyframe> keyframes;
+        unsigned char slots[MAX_DMX_CHANNELS];
+    };
+
+    struct Record
+    {
+        unsigned char type;
+        unsigned long long micros;
+        unsigned int universe;
+        const unsigned char * payload;
+        unsigned int payloadSize;
+        size_t next;
+    };
+
+    Record readRecord(size_t offset)
+    {
+        Record r;
+        DMXrecording::readHeader(data + offset, r.type, r.micros, r.universe, r.payloadSize);
+        r.payload = data + offset + DMXrecording::headerSize;
+        r.next = offset + DMXrecording::headerSize + r.payloadSize;
+        return r;
+    };
+
+    // scans the file for its universes and keyframes, false if it ends in
+    // the middle of a record
+    bool index()
+    {
+        size_t offset = DMXrecording::magicSize;
+        bool first = true;
+        while(offset + DMXrecording::headerSize <= size)
+        {
+            Record r = readRecord(offset);
+            if(r.next > size)
+            {
+                break;
+            }
+            std::map<unsigned int, size_t>::iterator it = universeIndex.find(r.universe);
+            if(it == universeIndex.end())
+            {
+                it = universeIndex.insert(std::make_pair(r.universe, universes.size())).first;
+                universes.push_back(PlayedUniverse(r.universe));
+            }
+            if(r.type == DMXrecording::DMX_RECORD_KEYFRAME)
+            {
+                Keyframe k;
+                k.micros = r.micros;
+                k.offset = offset;
+                universes[it->second].keyframes.push_back(k);
+            }
+            if(first)
+            {
+                startMicros = r.micros;
+                first = false;
+            }
+            endMicros = r.micros;
+            offset = r.next;
+        }
+        indexedSize = offset;
+        return offset == size;
+    };
+
+    void apply(const Record & r, PlayedUniverse & universe)
+    {
+        if(!decoder.decode(r.payload, r.payloadSize, decoded, MAX_DMX_CHANNELS))
+        {
+            return;
+        }
+        if(r.type == DMXrecording::DMX_RECORD_KEYFRAME)
+        {
+            memcpy(universe.slots, decoded, MAX_DMX_CHANNELS);
+        }
+        else
+        {
+            for(int i = 0; i < MAX_DMX_CHANNELS; i++)
+            {
+                universe.slots[i] ^= decoded[i];
+            }
+        }
+        universe.changed = true;
+    };
+
+#ifdef _WIN32
+
+    bool map(const std::string & path)
+    {
+        std::ifstream in(path.c_str(), std::ios::binary);
+        if(!in)
+        {
+            return false;
+        }
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        data = contents.empty() ? NULL : &contents[0];
+        size = contents.size();
+        return data != NULL;
+    };
+
+    void unmap()
+    {
+        contents.clear();
+        data = NULL;
+        size = 0;
+    };
+
+    std::vector<unsigned char> contents;
+
+#else
+
+    bool map(const std::string & path)
+    {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if(fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void * mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if(mapped == MAP_FAILED)
+        {
+            return false;
+        }
+        madvise(mapped, st.st_size, MADV_SEQUENTIAL);
+        data = (const unsigned char *) mapped;
+        size = st.st_size;
+        return true;
+    };
+
+    void unmap()
+    {
+        if(data != NULL)
+        {
+            munmap((void *) data, size);
+        }
+        data = NULL;
+        size = 0;
+    };
+
+#endif
+
+    const unsigned char * data;
+    size_t size;
+    size_t indexedSize;
+
+    std::vector<PlayedUniverse> universes;
+    std::map<unsigned int, size_t> universeIndex;
+
+    DMXrunLength decoder;
+    unsigned char decoded[MAX_DMX_CHANNELS];
+
+    size_t cursor;
+    unsigned long long position;
+    unsigned long long startMicros;
+    unsigned long long endMicros;
+
+    bool playing;
+    bool loop;
+    bool locked;
+    unsigned long long lockOffset;
+
+    DMXlayer * targetLayer;
+    unsigned long long playStartMicros;
+    unsigned long long playStartPosition;
+    bool playStartPending;
+
+};
@@ -0,0 +1,150 @@
+//
+//  DMXprofile.h
+//  ofxOlaShaderLight
+//
+//  Channel layouts shared between fixtures, independent of openFrameworks.
+//
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <iostream>
+#include "DMXcurve.h"
+
+// One channel of a fixture profile. address and universe are relative to
+// the fixture, address 1 being the fixture's start address.
+
+class DMXchannel
+{
+public:
+    enum DMXchannelType
+    {
+        DMX_CHANNEL_RED,
+        DMX_CHANNEL_GREEN,
+        DMX_CHANNEL_BLUE,
+        DMX_CHANNEL_WHITE,
+        DMX_CHANNEL_CW,
+        DMX_CHANNEL_WW,
+        DMX_CHANNEL_COLOR_TEMPERATURE,
+        DMX_CHANNEL_BRIGHTNESS,
+        DMX_CHANNEL_HUE,
+        DMX_CHANNEL_SATURATION,
+        DMX_CHANNEL_TYPES
+    };
+
+    DMXchannel(unsigned int address, DMXchannelType type = DMX_CHANNEL_BRIGHTNESS, bool width16bit = false, bool inverted = false, unsigned int minValue = 0, unsigned int maxValue=255, unsigned int universe = 0, const DMXcurve * curve = NULL)
+    {
+        this->universe = universe;
+        this->curve = curve;
+        this->address = address;
+        this->type = type;
+        this->width16bit = width16bit;
+        this->minValue = minValue;
+        this->maxValue = maxValue;
+        this->inverted = inverted;
+    };
+
+    bool operator==(const DMXchannel & other) const
+    {
+        return type == other.type && universe == other.universe && address == other.address && minValue == other.minValue && maxValue == other.maxValue && width16bit == other.width16bit && inverted == other.inverted && curve == other.curve;
+    };
+
+    DMXchannelType type;
+    unsigned int universe;
+    unsigned int address;
+    unsigned int minValue;
+    unsigned int maxValue;
+    bool width16bit;
+    bool inverted;
+    // shared, not owned; NULL is linear
+    const DMXcurve * curve;
+
+};
+
+// An immutable channel layout, defined once and referenced by every fixture
+// of that type. Profiles are interned by name and live for the rest of the
+// program, so fixtures only hold a pointer plus their start address.
+
+class DMXprofile
+{
+public:
+
+    const std::string name;
+    const std::vector<DMXchannel> channels;
+
+    // returns the profile registered under name, creating it from channels
+    // the first time. A name always refers to the same layout: interning it
+    // again with other channels returns NULL, which leaves fixtures unpatched.
+    static const DMXprofile * intern(const std::string & name, const std::vector<DMXchannel> & channels)
+    {
+        std::map<std::string, DMXprofile*> & profiles = registry();
+        std::map<std::string, DMXprofile*>::iterator it = profiles.find(name);
+        if(it != profiles.end())
+        {
+            if(!(it->second->channels == channels))
+            {
+                std::cerr << "DMXprofile: " << name << " is already interned with other channels" << std::endl;
+                return NULL;
+            }
+            return it->second;
+        }
+        DMXprofile * profile = new DMXprofile(name, channels);
+        profiles[name] = profile;
+        return profile;
+    };
+
+    // NULL if nothing has been interned under name
+    static const DMXprofile * get(const std::string & name)
+    {
+        std::map<std::string, DMXprofile*> & profiles = registry();
+        std::map<std::string, DMXprofile*>::iterator it = profiles.find(name);
+        return it != profiles.end() ? it->second : NULL;
+    };
+
+    // number of addresses the profile occupies from the start address
+    unsigned int getFootprint() const
+    {
+        unsigned int footprint = 0;
+        for(std::vector<DMXchannel>::const_iterator it = channels.begin(); it != channels.end(); it++)
+        {
+            unsigned int last = it->address + (it->width16bit ? 1 : 0);
+            footprint = last > footprint ? last : footprint;
+        }
+        return footprint;
+    };
+
+    bool usesType(DMXchannel::DMXchannelType type) const
+    {
+        return (types >> type) & 1;
+    };
+
+    // a single 8 bit dimmer channel
+    static const DMXprofile * brightness()
+    {
+        static const DMXprofile * profile = intern("brightness", std::vector<DMXchannel>(1, DMXchannel(1, DMXchannel::DMX_CHANNEL_BRIGHTNESS)));
+        return profile;
+    };
+
+protected:
+
+    DMXprofile(const std::string & name, const std::vector<DMXchannel> & channels) : name(name), channels(channels)
+    {
+        types = 0;
+        for(std::vector<DMXchannel>::const_iterator it = channels.begin(); it != channels.end(); it++)
+        {
+            types |= 1u << it->type;
+        }
+    };
+
+    // bit t is set when a channel has type t
+    unsigned int types;
+
+    static std::map<std::string, DMXprofile*> & registry()
+    {
+        static std::map<std::string, DMXprofile*> profiles;
+        return profiles;
+    };
+
+};
@@ -0,0 +1,415 @@
+//
+//  DMXrecorder.h
+//  ofxOlaShaderLight
+//
+//  Records what the output sends to an append-only file, independent of
+//  openFrameworks.
+//
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include "DMXoutput.h"
+
+#ifdef USE_OLA_LIB_AND_NOT_OSC
+#include <ola/DmxBuffer.h>
+#include <ola/dmx/RunLengthEncoder.h>
+#endif
+
+// Run length encoding in the format of ola::dmx::RunLengthEncoder: a byte
+// with the top bit set repeats the next byte (byte & 0x7f) times, any other
+// byte is followed by that many literal bytes. OLA builds use OLA's encoder,
+// OSC builds an equivalent one, and both read each other's files.
+
+class DMXrunLength
+{
+public:
+
+    // room for any encoding of a universe
+    static const unsigned int maxEncodedSize = MAX_DMX_CHANNELS * 2;
+
+    // data must hold maxEncodedSize bytes, returns the encoded size
+    unsigned int encode(const unsigned char * slots, unsigned int length, unsigned char * data)
+    {
+#ifdef USE_OLA_LIB_AND_NOT_OSC
+        buffer.Set(slots, length);
+        unsigned int size = maxEncodedSize;
+        encoder.Encode(buffer, data, &size);
+        return size;
+#else
+        unsigned int size = 0;
+        unsigned int i = 0;
+        while(i < length)
+        {
+            unsigned int j = i + 1;
+            while(j < length && slots[j] == slots[i] && j - i < 0x7f)
+            {
+                j++;
+            }
+            if(j - i > 2)
+            {
+                data[size++] = REPEAT_FLAG | (j - i);
+                data[size++] = slots[i];
+                i = j;
+                continue;
+            }
+            // literals up to the next run of three
+            for(j = i + 1; j < length && j - i < 0x7f; j++)
+            {
+                if(j + 2 < length && slots[j] == slots[j+1] && slots[j] == slots[j+2])
+                {
+                    break;
+                }
+            }
+            data[size++] = j - i;
+            memcpy(data + size, slots + i, j - i);
+            size += j - i;
+            i = j;
+        }
+        return size;
+#endif
+    };
+
+    // decodes into slots, which holds length values. False if data is corrupt
+    bool decode(const unsigned char * data, unsigned int size, unsigned char * slots, unsigned int length)
+    {
+#ifdef USE_OLA_LIB_AND_NOT_OSC
+        buffer.Set(slots, length);
+        if(!encoder.Decode(0, data, size, &buffer))
+        {
+            return false;
+        }
+        memcpy(slots, buffer.GetRaw(), std::min(length, buffer.Size()));
+        return true;
+#else
+        unsigned int i = 0;
+        unsigned int channel = 0;
+        while(i < size)
+        {
+            unsigned char count = data[i] & ~REPEAT_FLAG;
+            if(data[i] & REPEAT_FLAG)
+            {
+                if(i + 1 >= size || channel + count > length)
+                {
+                    return false;
+                }
+                memset(slots + channel, data[i+1], count);
+                i += 2;
+            }
+            else
+            {
+                if(i + 1 + count > size || channel + count > length)
+                {
+                    return false;
+                }
+                memcpy(slots + channel, data + i + 1, count);
+                i += 1 + count;
+            }
+            channel += count;
+        }
+        return true;
+#endif
+    };
+
+protected:
+
+    static const unsigned char REPEAT_FLAG = 0x80;
+
+#ifdef USE_OLA_LIB_AND_NOT_OSC
+    ola::DmxBuffer buffer;
+    ola::dmx::RunLengthEncoder encoder;
+#endif
+
+};
+
+// A recording is the magic "DMXREC1\n" followed by records of
+//
+//   u8  type, DMX_RECORD_KEYFRAME or DMX_RECORD_DELTA
+//   u64 microseconds since the epoch
+//   u32 universe number
+//   u16 payload size
+//   payload, run length encoded
+//
+// all little endian. A keyframe's payload is the universe, a delta's is the
+// universe XORed with the previous record of that universe, which is mostly
+// zeros and so encodes to a few bytes. Every universe starts with a keyframe
+// each time recording starts, and again every keyframe interval; one that
+// doesn't change gets it with the output's next keep-alive.
+
+class DMXrecording
+{
+public:
+
+    enum DMXrecordType
+    {
+        DMX_RECORD_KEYFRAME = 1,
+        DMX_RECORD_DELTA = 2
+    };
+
+    static const unsigned int headerSize = 1 + 8 + 4 + 2;
+
+    static const char * magic()
+    {
+        return "DMXREC1\n";
+    };
+
+    static const unsigned int magicSize = 8;
+
+    static void writeHeader(unsigned char * header, unsigned char type, unsigned long long micros, unsigned int universe, unsigned int payloadSize)
+    {
+        header[0] = type;
+        for(int i = 0; i < 8; i++)
+        {
+            header[1+i] = (micros >> (8*i)) & 0xff;
+        }
+        for(int i = 0; i < 4; i++)
+        {
+            header[9+i] = (universe >> (8*i)) & 0xff;
+        }
+        header[13] = payloadSize & 0xff;
+        header[14] = (payloadSize >> 8) & 0xff;
+    };
+
+    static void readHeader(const unsigned char * header, unsigned char & type, unsigned long long & micros, unsigned int & universe, unsigned int & payloadSize)
+    {
+        type = header[0];
+        micros = 0;
+        for(int i = 0; i < 8; i++)
+        {
+            micros |= (unsigned long long) header[1+i] << (8*i);
+        }
+        universe = 0;
+        for(int i = 0; i < 4; i++)
+        {
+            universe |= (unsigned int) header[9+i] << (8*i);
+        }
+        payloadSize = header[13] | (header[14] << 8);
+    };
+
+};
+
+// An output tap that records every universe the output sends. The sending
+// side only copies the universe into a lock-free queue;
+// encoding and buffered writing happen on the recorder's own thread. When
+// the queue is full universes are dropped and counted rather than making
+// the output wait.
+
+class DMXrecorder : public DMXoutputTap
+{
+public:
+
+    DMXrecorder()
+    {
+        file = NULL;
+        running = false;
+        head = 0;
+        tail = 0;
+        dropped = 0;
+        senders = 0;
+        keyframeMillis = 1000;
+    };
+
+    ~DMXrecorder()
+    {
+        stop();
+    };
+
+    // appends to path, queueSize is the number of universes that can wait
+    // for the writer
+    bool start(const std::string & path, size_t queueSize = 4096)
+    {
+        stop();
+        file = fopen(path.c_str(), "ab");
+        if(file == NULL)
+        {
+            std::cerr << "DMXrecorder: could not open " << path << std::endl;
+            return false;
+        }
+        setvbuf(file, NULL, _IOFBF, 1 << 20);
+        fseek(file, 0, SEEK_END);
+        if(ftell(file) == 0)
+        {
+            fwrite(DMXrecording::magic(), 1, DMXrecording::magicSize, file);
+        }
+        queue.resize(queueSize + 1);
+        head = 0;
+        tail = 0;
+        dropped = 0;
+        previous.clear();
+        startSteady = std::chrono::steady_clock::now();
+        startMicros = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+        running = true;
+        thread = std::thread(&DMXrecorder::threadedFunction, this);
+        return true;
+    };
+
+    // writes what is queued and closes the file. A send still inside
+    // universeSent() is waited for, so start() can reset the queue even
+    // while the recorder is still an output's tap.
+    void stop()
+    {
+        if(running)
+        {
+            running = false;
+            while(senders.load() > 0)
+            {
+                std::this_thread::yield();
+            }
+            thread.join();
+            fclose(file);
+            file = NULL;
+        }
+    };
+
+    bool isRecording()
+    {
+        return running;
+    };
+
+    // how often every universe gets a keyframe, which bounds the delta
+    // chain a player has to follow after seeking
+    void setKeyframeInterval(unsigned int millis)
+    {
+        keyframeMillis = millis;
+    };
+
+    // universes lost because the writer fell behind
+    unsigned long long getDroppedUniverses()
+    {
+        return dropped;
+    };
+
+    // sending side
+    void universeSent(unsigned int number, const unsigned char * slots)
+    {
+        // counted in before running is looked at, so stop() sees it
+        senders++;
+        if(!running)
+        {
+            senders--;
+            return;
+        }
+        size_t h = head.load(std::memory_order_relaxed);
+        size_t next = (h + 1) % queue.size();
+        if(next == tail.load(std::memory_order_acquire))
+        {
+            dropped++;
+            senders--;
+            return;
+        }
+        QueuedUniverse & q = queue[h];
+        q.micros = startMicros + std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startSteady).count();
+        q.number = number;
+        memcpy(q.slots, slots, MAX_DMX_CHANNELS);
+        head.store(next, std::memory_order_release);
+        senders--;
+    };
+
+protected:
+
+    struct QueuedUniverse
+    {
+        unsigned long long micros;
+        unsigned int number;
+        unsigned char slots[MAX_DMX_CHANNELS];
+    };
+
+    struct RecordedUniverse
+    {
+        RecordedUniverse() : keyframeMicros(0) {};
+        unsigned long long keyframeMicros;
+        unsigned char slots[MAX_DMX_CHANNELS];
+    };
+
+    void threadedFunction()
+    {
+        std::chrono::steady_clock::time_point lastFlush = std::chrono::steady_clock::now();
+        bool stopping = false;
+        while(!stopping)
+        {
+            // drain once more after stop() so nothing queued is lost
+            stopping = !running;
+            bool wrote = false;
+            size_t t = tail.load(std::memory_order_relaxed);
+            while(t != head.load(std::memory_order_acquire))
+            {
+                write(queue[t]);
+                t = (t + 1) % queue.size();
+                tail.store(t, std::memory_order_release);
+                wrote = true;
+            }
+            // buffered, but flushed once a second so a crash loses little
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if(wrote && now - lastFlush > std::chrono::seconds(1))
+            {
+                fflush(file);
+                lastFlush = now;
+            }
+            if(!wrote && !stopping)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+    };
+
+    void write(const QueuedUniverse & q)
+    {
+        std::map<unsigned int, RecordedUniverse>::iterator it = previous.find(q.number);
+        bool keyframe = it == previous.end() || q.micros - it->second.keyframeMicros >= keyframeMillis * 1000ull;
+        RecordedUniverse & last = previous[q.number];
+        // a keep-alive between keyframes records nothing new
+        if(!keyframe && memcmp(q.slots, last.slots, MAX_DMX_CHANNELS) == 0)
+        {
+            return;
+        }
+        const unsigned char * payload = q.slots;
+        if(!keyframe)
+        {
+            for(int i = 0; i < MAX_DMX_CHANNELS; i++)
+            {
+                delta[i] = q.slots[i] ^ last.slots[i];
+            }
+            payload = delta;
+        }
+        else
+        {
+            last.keyframeMicros = q.micros;
+        }
+        unsigned int size = encoder.encode(payload, MAX_DMX_CHANNELS, encoded);
+        DMXrecording::writeHeader(header, keyframe ? DMXrecording::DMX_RECORD_KEYFRAME : DMXrecording::DMX_RECORD_DELTA, q.micros, q.number, size);
+        fwrite(header, 1, DMXrecording::headerSize, file);
+        fwrite(encoded, 1, size, file);
+        memcpy(last.slots, q.slots, MAX_DMX_CHANNELS);
+    };
+
+    FILE * file;
+    std::atomic<bool> running;
+    std::thread thread;
+
+    std::vector<QueuedUniverse> queue;
+    std::atomic<size_t> head;
+    std::atomic<size_t> tail;
+    std::atomic<unsigned long long> dropped;
+    // sends inside universeSent()
+    std::atomic<int> senders;
+
+    std::atomic<unsigned int> keyframeMillis;
+    std::chrono::steady_clock::time_point startSteady;
+    unsigned long long startMicros;
+
+    // writer thread only
+    std::map<unsigned int, RecordedUniverse> previous;
+    DMXrunLength encoder;
+    unsigned char delta[MAX_DMX_CHANNELS];
+    unsigned char encoded[DMXrunLength::maxEncodedSize];
+    unsigned char header[DMXrecording::headerSize];
+
+};
@@ -0,0 +1,267 @@
+//
+//  DMXsacnTransport.h
+//  ofxOlaShaderLight
+//
+//  Sends universes as sACN (E1.31) straight to the network, without olad.
+//  Independent of openFrameworks.
+//
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstring>
+#include <random>
+#include <iostream>
+#include "DMXoutput.h"
+#include "DMXudp.h"
+
+// Every universe gets its E1.31 data packet built once, the first time it
+// is sent; after that a frame only writes the sequence number and the slots
+// into it. The packets of a frame are queued and go out together in flush().
+// Universes are multicast to 239.255.x.y, or unicast to a host when one is
+// given. With universe sync on, every data packet names the sync universe
+// and receivers hold the frame until the sync packet that follows it.
+
+class DMXsacnTransport : public DMXtransport
+{
+public:
+
+    static const unsigned short port = 5568;
+
+    DMXsacnTransport(std::string sourceName = "ofxOlaShaderLight", std::string unicastHost = "", unsigned short destinationPort = port)
+    {
+        this->sourceName = sourceName;
+        this->unicastHost = unicastHost;
+        this->destinationPort = destinationPort;
+        priority = 100;
+        universeOffset = 1;
+        syncUniverse = 0;
+        syncSequence = 0;
+        std::random_device random;
+        for(int i = 0; i < 16; i++)
+        {
+            cid[i] = random() & 0xff;
+        }
+    };
+
+    ~DMXsacnTransport()
+    {
+        if(udp.isOpen())
+        {
+            terminate();
+        }
+    };
+
+    bool setup()
+    {
+        sockaddr_in address;
+        if(!unicastHost.empty() && !DMXudpSocket::address(unicastHost, destinationPort, address))
+        {
+            std::cerr << "sACN: " << unicastHost << " is not an IPv4 address" << std::endl;
+            return false;
+        }
+        if(!udp.open())
+        {
+            std::cerr << "sACN socket failed" << std::endl;
+            return false;
+        }
+        return true;
+    };
+
+    // the settings below rebuild the packets, set them from the thread that
+    // sends or before sending starts
+
+    // sACN universe = engine universe + offset, as sACN starts at 1
+    void setUniverseOffset(unsigned int offset)
+    {
+        universeOffset = offset;
+        packets.clear();
+    };
+
+    // 0 to 200, sent with every packet
+    void setPriority(unsigned char priority)
+    {
+        this->priority = priority > 200 ? 200 : priority;
+        rebuildDataPackets();
+    };
+
+    // the sACN universe sync packets go to, 0 turns sync off
+    void setSyncUniverse(unsigned short universe)
+    {
+        syncUniverse = universe;
+        rebuildDataPackets();
+        buildSyncPacket();
+    };
+
+    void sendUniverse(unsigned int number, const unsigned char * slots, const unsigned char * /* previous */)
+    {
+        unsigned int universe = number + universeOffset;
+        if(!udp.isOpen() || universe < 1 || universe > 63999)
+        {
+            return;
+        }
+        std::map<unsigned int, Packet>::iterator it = packets.find(universe);
+        if(it == packets.end())
+        {
+            it = packets.insert(std::make_pair(universe, Packet())).first;
+            buildDataPacket(it->second, universe);
+        }
+        Packet & p = it->second;
+        p.data[SEQUENCE] = p.sequence++;
+        memcpy(p.data + SLOTS, slots, MAX_DMX_CHANNELS);
+        udp.queue(p.data, DATA_PACKET_SIZE, p.destination);
+    };
+
+    void flush()
+    {
+        if(udp.queued() == 0)
+        {
+            return;
+        }
+        if(syncUniverse != 0)
+        {
+            syncPacket[SYNC_SEQUENCE] = syncSequence++;
+            udp.queue(syncPacket, SYNC_PACKET_SIZE, syncDestination);
+        }
+        if(!udp.send())
+        {
+            std::cerr << "sACN send failed" << std::endl;
+        }
+    };
+
+protected:
+
+    enum {
+        DATA_PACKET_SIZE = 126 + MAX_DMX_CHANNELS,
+        SYNC_PACKET_SIZE = 49,
+        SEQUENCE = 111,
+        OPTIONS = 112,
+        SLOTS = 126,
+        SYNC_SEQUENCE = 44,
+        OPTION_STREAM_TERMINATED = 0x40
+    };
+
+    struct Packet
+    {
+        Packet() : sequence(0) {};
+        unsigned char sequence;
+        sockaddr_in destination;
+        unsigned char data[DATA_PACKET_SIZE];
+    };
+
+    static void write16(unsigned char * p, unsigned int value)
+    {
+        p[0] = (value >> 8) & 0xff;
+        p[1] = value & 0xff;
+    };
+
+    static void write32(unsigned char * p, unsigned int value)
+    {
+        write16(p, value >> 16);
+        write16(p + 2, value & 0xffff);
+    };
+
+    // flags and length of a PDU that runs from offset to the end of the packet
+    static void writeFlagsAndLength(unsigned char * packet, unsigned int offset, unsigned int size)
+    {
+        write16(packet + offset, 0x7000 | (size - offset));
+    };
+
+    void writeRootLayer(unsigned char * packet, unsigned int size, unsigned int vector)
+    {
+        write16(packet, 0x0010);
+        write16(packet + 2, 0x0000);
+        memcpy(packet + 4, "ASC-E1.17\0\0\0", 12);
+        writeFlagsAndLength(packet, 16, size);
+        write32(packet + 18, vector);
+        memcpy(packet + 22, cid, 16);
+    };
+
+    sockaddr_in destinationFor(unsigned int universe)
+    {
+        sockaddr_in destination;
+        if(!DMXudpSocket::address(unicastHost, destinationPort, destination))
+        {
+            destination.sin_addr.s_addr = htonl(0xefff0000 | (universe & 0xffff));
+        }
+        return destination;
+    };
+
+    void buildDataPacket(Packet & p, unsigned int universe)
+    {
+        unsigned char * d = p.data;
+        memset(d, 0, DATA_PACKET_SIZE);
+        writeRootLayer(d, DATA_PACKET_SIZE, 0x00000004);
+        // framing layer
+        writeFlagsAndLength(d, 38, DATA_PACKET_SIZE);
+        write32(d + 40, 0x00000002);
+        strncpy((char *) d + 44, sourceName.c_str(), 63);
+        d[108] = priority;
+        write16(d + 109, syncUniverse);
+        write16(d + 113, universe);
+        // DMP layer, one property per slot after the start code
+        writeFlagsAndLength(d, 115, DATA_PACKET_SIZE);
+        d[117] = 0x02;
+        d[118] = 0xa1;
+        write16(d + 119, 0x0000);
+        write16(d + 121, 0x0001);
+        write16(d + 123, MAX_DMX_CHANNELS + 1);
+        d[125] = 0x00;
+        p.destination = destinationFor(universe);
+    };
+
+    // keeps the sequence numbers, receivers drop packets that go back
+    void rebuildDataPackets()
+    {
+        for(std::map<unsigned int, Packet>::iterator it = packets.begin(); it != packets.end(); it++)
+        {
+            buildDataPacket(it->second, it->first);
+        }
+    };
+
+    void buildSyncPacket()
+    {
+        memset(syncPacket, 0, SYNC_PACKET_SIZE);
+        writeRootLayer(syncPacket, SYNC_PACKET_SIZE, 0x00000008);
+        writeFlagsAndLength(syncPacket, 38, SYNC_PACKET_SIZE);
+        write32(syncPacket + 40, 0x00000001);
+        write16(syncPacket + 45, syncUniverse);
+        syncDestination = destinationFor(syncUniverse);
+    };
+
+    // tells receivers the stream ends rather than letting it time out
+    void terminate()
+    {
+        for(std::map<unsigned int, Packet>::iterator it = packets.begin(); it != packets.end(); it++)
+        {
+            it->second.data[OPTIONS] |= OPTION_STREAM_TERMINATED;
+        }
+        for(int i = 0; i < 3; i++)
+        {
+            for(std::map<unsigned int, Packet>::iterator it = packets.begin(); it != packets.end(); it++)
+            {
+                it->second.data[SEQUENCE] = it->second.sequence++;
+                udp.queue(it->second.data, DATA_PACKET_SIZE, it->second.destination);
+            }
+            udp.send();
+        }
+    };
+
+    std::string sourceName;
+    std::string unicastHost;
+    unsigned short destinationPort;
+    DMXudpSocket udp;
+    unsigned char cid[16];
+    unsigned char priority;
+    unsigned int universeOffset;
+
+    unsigned short syncUniverse;
+    unsigned char syncSequence;
+    unsigned char syncPacket[SYNC_PACKET_SIZE];
+    sockaddr_in syncDestination;
+
+    std::map<unsigned int, Packet> packets;
+
+};
@@ -0,0 +1,154 @@
+//
+//  DMXslotMap.h
+//  ofxOlaShaderLight
+//
+//  A registry with stable handles, independent of openFrameworks.
+//
+
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+// Refers to an element of a DMXslotMap. A handle stays valid until its
+// element is erased; after that it never matches again, even when the
+// slot is reused.
+
+struct DMXhandle
+{
+    DMXhandle() : index(~0u), generation(0) {};
+    DMXhandle(unsigned int index, unsigned int generation) : index(index), generation(generation) {};
+
+    bool operator==(const DMXhandle & other) const
+    {
+        return index == other.index && generation == other.generation;
+    };
+
+    bool operator!=(const DMXhandle & other) const
+    {
+        return !(*this == other);
+    };
+
+    unsigned int index;
+    unsigned int generation;
+};
+
+// O(1) insert, erase and lookup by handle, with the elements kept packed in
+// one vector for iteration. Erasing moves the last element into the gap,
+// so iteration order is not stable.
+
+template<typename T>
+class DMXslotMap
+{
+public:
+
+    typedef typename std::vector<T>::iterator iterator;
+    typedef typename std::vector<T>::const_iterator const_iterator;
+
+    DMXhandle insert(const T & value)
+    {
+        unsigned int slot;
+        if(freeSlots.empty())
+        {
+            slot = slots.size();
+            slots.push_back(Slot());
+        }
+        else
+        {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        slots[slot].dense = dense.size();
+        dense.push_back(value);
+        denseSlots.push_back(slot);
+        return DMXhandle(slot, slots[slot].generation);
+    };
+
+    bool erase(DMXhandle handle)
+    {
+        if(!contains(handle))
+        {
+            return false;
+        }
+        unsigned int d = slots[handle.index].dense;
+        unsigned int last = dense.size()-1;
+        if(d != last)
+        {
+            dense[d] = dense[last];
+            denseSlots[d] = denseSlots[last];
+            slots[denseSlots[d]].dense = d;
+        }
+        dense.pop_back();
+        denseSlots.pop_back();
+        slots[handle.index].generation++;
+        freeSlots.push_back(handle.index);
+        return true;
+    };
+
+    bool contains(DMXhandle handle) const
+    {
+        return handle.index < slots.size() && slots[handle.index].generation == handle.generation;
+    };
+
+    // NULL if the handle's element has been erased
+    T * get(DMXhandle handle)
+    {
+        return contains(handle) ? &dense[slots[handle.index].dense] : NULL;
+    };
+
+    // the handle of the element at position i of the packed order
+    DMXhandle handleAt(size_t i) const
+    {
+        return DMXhandle(denseSlots[i], slots[denseSlots[i]].generation);
+    };
+
+    T & operator[](size_t i)
+    {
+        return dense[i];
+    };
+
+    size_t size() const
+    {
+        return dense.size();
+    };
+
+    bool empty() const
+    {
+        return dense.empty();
+    };
+
+    iterator begin()
+    {
+        return dense.begin();
+    };
+
+    iterator end()
+    {
+        return dense.end();
+    };
+
+    const_iterator begin() const
+    {
+        return dense.begin();
+    };
+
+    const_iterator end() const
+    {
+        return dense.end();
+    };
+
+protected:
+
+    struct Slot
+    {
+        Slot() : dense(0), generation(0) {};
+        unsigned int dense;
+        unsigned int generation;
+    };
+
+    std::vector<T> dense;
+    std::vector<unsigned int> denseSlots;
+    std::vector<Slot> slots;
+    std::vector<unsigned int> freeSlots;
+
+};
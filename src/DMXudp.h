@@ -0,0 +1,203 @@
+//
+//  DMXudp.h
+//  ofxOlaShaderLight
+//
+//  A UDP socket for the network transports, POSIX sockets.
+//
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <iostream>
+
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+// Datagrams are queued during a frame and sent together by send(), with
+// one sendmmsg() call on Linux. A datagram can be a header and data from
+// two places, gathered by the kernel. Queued data and destinations are not
+// copied, they must stay put until send(). Receiving never blocks.
+
+class DMXudpSocket
+{
+public:
+
+    DMXudpSocket()
+    {
+        fd = -1;
+    };
+
+    ~DMXudpSocket()
+    {
+        close();
+    };
+
+    // port 0 binds to any free port
+    bool open(unsigned short port = 0, bool broadcast = false)
+    {
+        close();
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if(fd < 0)
+        {
+            return false;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if(broadcast)
+        {
+            setsockopt(fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+        }
+        unsigned char ttl = 16;
+        setsockopt(fd, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+        sockaddr_in local;
+        memset(&local, 0, sizeof(local));
+        local.sin_family = AF_INET;
+        local.sin_addr.s_addr = htonl(INADDR_ANY);
+        local.sin_port = htons(port);
+        if(bind(fd, (const sockaddr *) &local, sizeof(local)) != 0)
+        {
+            close();
+            return false;
+        }
+        return true;
+    };
+
+    void close()
+    {
+        if(fd >= 0)
+        {
+            ::close(fd);
+        }
+        fd = -1;
+        pending.clear();
+    };
+
+    bool isOpen()
+    {
+        return fd >= 0;
+    };
+
+    // false if host isn't a dotted IPv4 address
+    static bool address(const std::string & host, unsigned short port, sockaddr_in & address)
+    {
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        return inet_pton(AF_INET, host.c_str(), &address.sin_addr) == 1;
+    };
+
+    void queue(const unsigned char * data, size_t size, const sockaddr_in & destination)
+    {
+        queue(NULL, 0, data, size, destination);
+    };
+
+    void queue(const unsigned char * header, size_t headerSize, const unsigned char * data, size_t size, const sockaddr_in & destination)
+    {
+        Datagram d;
+        d.header = header;
+        d.headerSize = headerSize;
+        d.data = data;
+        d.size = size;
+        d.destination = &destination;
+        pending.push_back(d);
+    };
+
+    size_t queued()
+    {
+        return pending.size();
+    };
+
+    // sends what is queued, false if some of it couldn't be
+    bool send()
+    {
+        if(fd < 0)
+        {
+            pending.clear();
+            return false;
+        }
+        bool ok = true;
+        iovecs.resize(pending.size() * 2);
+#ifdef __linux__
+        headers.resize(pending.size());
+#endif
+        for(size_t i = 0; i < pending.size(); i++)
+        {
+            Datagram & d = pending[i];
+            iovec * iov = &iovecs[i*2];
+            int parts = 0;
+            if(d.headerSize > 0)
+            {
+                iov[parts].iov_base = (void *) d.header;
+                iov[parts].iov_len = d.headerSize;
+                parts++;
+            }
+            iov[parts].iov_base = (void *) d.data;
+            iov[parts].iov_len = d.size;
+            parts++;
+#ifdef __linux__
+            msghdr & h = headers[i].msg_hdr;
+#else
+            msghdr h;
+#endif
+            memset(&h, 0, sizeof(h));
+            h.msg_name = (void *) d.destination;
+            h.msg_namelen = sizeof(sockaddr_in);
+            h.msg_iov = iov;
+            h.msg_iovlen = parts;
+#ifndef __linux__
+            ok &= sendmsg(fd, &h, 0) >= 0;
+#endif
+        }
+#ifdef __linux__
+        size_t sent = 0;
+        while(sent < headers.size())
+        {
+            int n = sendmmsg(fd, &headers[sent], headers.size() - sent, 0);
+            if(n <= 0)
+            {
+                // skip the datagram that failed, e.g. an unreachable host
+                ok = false;
+                n = 1;
+            }
+            sent += n;
+        }
+#endif
+        pending.clear();
+        return ok;
+    };
+
+    // the size of the datagram read into data, -1 when none is waiting
+    int receive(unsigned char * data, size_t size, sockaddr_in & from)
+    {
+        if(fd < 0)
+        {
+            return -1;
+        }
+        socklen_t length = sizeof(from);
+        return recvfrom(fd, data, size, MSG_DONTWAIT, (sockaddr *) &from, &length);
+    };
+
+protected:
+
+    struct Datagram
+    {
+        const unsigned char * header;
+        size_t headerSize;
+        const unsigned char * data;
+        size_t size;
+        const sockaddr_in * destination;
+    };
+
+    int fd;
+    std::vector<Datagram> pending;
+    std::vector<iovec> iovecs;
+#ifdef __linux__
+    std::vector<mmsghdr> headers;
+#endif
+
+};
@@ -13,16 +13,26 @@ bool ofxOlaShaderLight::enabled = false;
 ofxOlaShaderLight::shadingType ofxOlaShaderLight::shading = OFX_OLA_SHADER_LIGHT_PHONG;
 ofxUboShader * ofxOlaShaderLight::shader = new ofxUboShader();
 ofxOlaShaderLight::Light ofxOlaShaderLight::lightStruct = ofxOlaShaderLight::Light();
+ofxOlaShaderLight::Light ofxOlaShaderLight::uploadedLightStruct = ofxOlaShaderLight::Light();
+bool ofxOlaShaderLight::lightStructUploaded = false;
 
-vector<DMXfixture*> * DMXfixture::DMXfixtures = new vector<DMXfixture*>;
 bool DMXfixture::oladSetup = false;
 
-#ifdef USE_OLA_LIB_AND_NOT_OSC
- ola::DmxBuffer * DMXfixture::buffer = new ola::DmxBuffer();
- ola::StreamingClient * DMXfixture::ola_client = new ola::StreamingClient();
+#if defined(USE_SACN_TRANSPORT)
+DMXsacnTransport * DMXfixture::transport = new DMXsacnTransport();
+#elif defined(USE_ARTNET_TRANSPORT)
+DMXartnetTransport * DMXfixture::transport = new DMXartnetTransport();
+#elif defined(USE_OLA_LIB_AND_NOT_OSC)
+DMXolaTransport * DMXfixture::transport = new DMXolaTransport();
 #else
-ofxOscSender * DMXfixture::oscSender = new ofxOscSender();
-int * DMXfixture::buffer = new int[512];
-#endif // USE_OLA_LIB_AND_NOT_OSC/*
-
-
+DMXoscTransport * DMXfixture::transport = new DMXoscTransport("localhost", 7770);
+#endif
+#ifdef USE_ASYNC_OUTPUT
+DMXasyncTransport * DMXfixture::asyncTransport = new DMXasyncTransport(DMXfixture::transport);
+DMXengine * DMXfixture::engine = new DMXengine(DMXfixture::asyncTransport);
+#else
+DMXengine * DMXfixture::engine = new DMXengine(DMXfixture::transport);
+#endif
+DMXrecorder * DMXfixture::recorder = new DMXrecorder();
+DMXplayer * DMXfixture::player = new DMXplayer();
+DMXclock * DMXfixture::showClock = new DMXclock();
@@ -9,100 +9,118 @@
 #pragma once
 
 #include "ofMain.h"
-#ifdef USE_OLA_LIB_AND_NOT_OSC
-#include <ola/DmxBuffer.h>
-#include <ola/Logging.h>
-#include <ola/StreamingClient.h>
-#else
-#include "ofxOsc.h"
+#include "DMXengine.h"
+#include "DMXrecorder.h"
+#include "DMXplayer.h"
+#include "DMXpixelMap.h"
+#if defined(USE_SACN_TRANSPORT)
+#include "DMXsacnTransport.h"
+#elif defined(USE_ARTNET_TRANSPORT)
+#include "DMXartnetTransport.h"
+#elif !defined(USE_OLA_LIB_AND_NOT_OSC)
+#include "DMXoscTransport.h"
+#endif
+#ifdef USE_ASYNC_OUTPUT
+#include "DMXasyncTransport.h"
 #endif
 #include "ofxUbo.h"
 
 #define MAX_SHADER_LIGHTS 512
 
-class DMXchannel
-{
-public:
-    enum DMXchannelType
-    {
-        DMX_CHANNEL_RED,
-        DMX_CHANNEL_GREEN,
-        DMX_CHANNEL_BLUE,
-        DMX_CHANNEL_WHITE,
-        DMX_CHANNEL_CW,
-        DMX_CHANNEL_WW,
-        DMX_CHANNEL_COLOR_TEMPERATURE,
-        DMX_CHANNEL_BRIGHTNESS,
-        DMX_CHANNEL_HUE,
-        DMX_CHANNEL_SATURATION
-    };
-
-    DMXchannel(unsigned int address, DMXchannelType type = DMX_CHANNEL_BRIGHTNESS, bool width16bit = false, bool inverted = false, unsigned int minValue = 0, unsigned int maxValue=255)
-    {
-        this->address = address;
-        this->type = type;
-        this->width16bit = width16bit;
-        this->minValue = minValue;
-        this->maxValue = maxValue;
-        this->inverted = inverted;
-    };
-
-    DMXchannelType type;
-    unsigned int address;
-    unsigned int minValue;
-    unsigned int maxValue;
-    bool width16bit;
-    bool inverted;
-
-};
+// An ofLight that drives DMX. The DMX side lives in a DMXfixtureState of
+// the shared DMXengine; this class keeps it in sync with the ofLight.
 
 class DMXfixture : public ofLight
 {
     static bool oladSetup;
 public:
 
-#ifdef USE_OLA_LIB_AND_NOT_OSC
-    static ola::DmxBuffer * buffer;
-    static ola::StreamingClient * ola_client;
+#if defined(USE_SACN_TRANSPORT)
+    static DMXsacnTransport * transport;
+#elif defined(USE_ARTNET_TRANSPORT)
+    static DMXartnetTransport * transport;
+#elif defined(USE_OLA_LIB_AND_NOT_OSC)
+    static DMXolaTransport * transport;
 #else
-    static ofxOscSender * oscSender;
-    static int * buffer;
+    static DMXoscTransport * transport;
+#endif
+#ifdef USE_ASYNC_OUTPUT
+    // sends through transport from a thread of its own
+    static DMXasyncTransport * asyncTransport;
 #endif
+    static DMXengine * engine;
+    static DMXrecorder * recorder;
+    static DMXplayer * player;
+    static DMXclock * showClock;
 
     DMXfixture()
     {
-        if(!oladSetup)
+        setupOutput();
+        temperature = 0;
+        temperatureRangeColdKelvin = 0;
+        temperatureRangeWarmKelvin = 0;
+        handle = engine->addFixture(this);
+        syncState();
+    };
+
+    // a copy is a fixture of its own, with its own state in the engine, so
+    // fixtures can live in a vector that grows
+    DMXfixture(const DMXfixture & other) : ofLight(other)
+    {
+        temperature = other.temperature;
+        temperatureRangeColdKelvin = other.temperatureRangeColdKelvin;
+        temperatureRangeWarmKelvin = other.temperatureRangeWarmKelvin;
+        handle = engine->addFixture(this);
+        copyState(other);
+    };
+
+    DMXfixture & operator=(const DMXfixture & other)
+    {
+        if(this != &other)
         {
-#ifdef USE_OLA_LIB_AND_NOT_OSC
-            ola::InitLogging(ola::OLA_LOG_WARN, ola::OLA_LOG_STDERR);
-            // Setup the client, this connects to the server
-            if (!ola_client->Setup())
-            {
-                std::cerr << "OLA Setup failed" << std::endl;
-            }
-#else
-            oscSender->setup("localhost", 7770);
-#endif
-            oladSetup = true;
+            ofLight::operator=(other);
+            temperature = other.temperature;
+            temperatureRangeColdKelvin = other.temperatureRangeColdKelvin;
+            temperatureRangeWarmKelvin = other.temperatureRangeWarmKelvin;
+            copyState(other);
         }
-        addMe();
+        return *this;
     };
 
     ~DMXfixture()
     {
-        if(!DMXfixtures->empty()){
-            removeMe();
-        }
+        engine->removeFixture(handle);
+    };
+
+    void setProfile(const DMXprofile * profile, int startAddress, unsigned int universe = 0)
+    {
+        engine->setProfile(handle, profile, startAddress, universe);
+    };
+
+    const DMXprofile * getProfile()
+    {
+        DMXfixtureState * state = getState();
+        return state != NULL ? state->profile : NULL;
+    };
+
+    int getDMXstartAddress()
+    {
+        DMXfixtureState * state = getState();
+        return state != NULL ? state->startAddress : 0;
     };
 
-    vector <DMXchannel*> DMXchannels;
-    int DMXstartAddress;
+    unsigned int getDMXstartUniverse()
+    {
+        DMXfixtureState * state = getState();
+        return state != NULL ? state->universe : 0;
+    };
 
     void setNormalisedBrightness(float brightness)
     {
         ofFloatColor c = ofLight::getDiffuseColor();
         c.setBrightness(brightness);
         ofLight::setDiffuseColor(c);
+        markChanged();
     };
 
     float getNormalisedBrightness()
@@ -116,6 +134,7 @@ public:
         ofFloatColor c = DMXfixture::temperatureToColor(temperature);
         c.setBrightness(getNormalisedBrightness());
         ofLight::setDiffuseColor(c);
+        markChanged();
     };
 
     unsigned int getTemperature()
@@ -123,123 +142,272 @@ public:
         return temperature;
     };
 
-    static void update()
+    // hides ofLight::setDiffuseColor so colour changes reach the next update()
+    void setDiffuseColor(const ofFloatColor& c)
     {
-#ifdef USE_OLA_LIB_AND_NOT_OSC
-        buffer->Blackout();
-#endif
-        for(vector<DMXfixture*>::iterator it = DMXfixtures->begin(); it != DMXfixtures->end(); it++)
-        {
-            DMXfixture * f = *(it);
+        ofLight::setDiffuseColor(c);
+        markChanged();
+    };
 
-            for(std::vector<DMXchannel*>::iterator chIt = f->DMXchannels.begin(); chIt != f->DMXchannels.end(); chIt++)
-            {
+    // fades run at the output rate until they end or the fixture is set
+    // directly; update() carries the faded colour into the ofLight
 
-                DMXchannel* c = *(chIt);
+    void fadeToColor(const ofFloatColor & c, float seconds, const DMXcurve * curve = NULL)
+    {
+        syncState();
+        engine->fadeTo(handle, c.r, c.g, c.b, temperature, seconds, curve);
+    };
 
-                // set the normalised value as a float
+    void fadeToBrightness(float brightness, float seconds, const DMXcurve * curve = NULL)
+    {
+        ofFloatColor c = ofLight::getDiffuseColor();
+        c.setBrightness(brightness);
+        fadeToColor(c, seconds, curve);
+    };
 
-                float value = 0;
-                if(c->type == DMXchannel::DMX_CHANNEL_BRIGHTNESS)
-                {
-                    value = f->getNormalisedBrightness();
-                }
-                if(c->type == DMXchannel::DMX_CHANNEL_RED)
-                {
-                    value = f->ofLight::getDiffuseColor().r;
-                }
-                if(c->type == DMXchannel::DMX_CHANNEL_GREEN)
-                {
-                    value = f->ofLight::getDiffuseColor().g;
-                }
-                if(c->type == DMXchannel::DMX_CHANNEL_BLUE)
-                {
-                    value = f->ofLight::getDiffuseColor().b;
-                }
-                if(c->type == DMXchannel::DMX_CHANNEL_HUE)
-                {
-                    value = f->ofLight::getDiffuseColor().getHue();
-                }
-                if(c->type == DMXchannel::DMX_CHANNEL_SATURATION)
-                {
-                    value = f->ofLight::getDiffuseColor().getSaturation();
-                }
-                if(c->type == DMXchannel::DMX_CHANNEL_COLOR_TEMPERATURE)
-                {
-                    value = ofMap(f->getTemperature(), f->temperatureRangeWarmKelvin, f->temperatureRangeColdKelvin, 0, 1.);
-                }
-                if(c->type == DMXchannel::DMX_CHANNEL_CW)
-                {
-                    value = ofMap(f->getTemperature(), f->temperatureRangeColdKelvin, f->temperatureRangeWarmKelvin, 0, 1.);
-                    value = fminf(1.,ofMap(value, 0 , 0.5, 0., 1.));
-                    value *= f->getNormalisedBrightness();
-                }
-                if(c->type == DMXchannel::DMX_CHANNEL_WW)
-                {
-                    value = ofMap(f->getTemperature(), f->temperatureRangeWarmKelvin, f->temperatureRangeColdKelvin, 0, 1.);
-                    value = fminf(1.,ofMap(value, 0 , 0.5, 0., 1.));
-                    value *= f->getNormalisedBrightness();
-                }
+    void fadeToTemperature(unsigned int degreesKelvin, float seconds, const DMXcurve * curve = NULL)
+    {
+        ofFloatColor c = DMXfixture::temperatureToColor(degreesKelvin);
+        c.setBrightness(getNormalisedBrightness());
+        syncState();
+        engine->fadeTo(handle, c.r, c.g, c.b, degreesKelvin, seconds, curve);
+    };
 
-                if(c->inverted){
-                    value = 1.0-value;
-                }
+    bool isFading()
+    {
+        return engine->isFading(handle);
+    };
 
-                // set int channel value as 8 or 16 bit;
+    void stopFade()
+    {
+        engine->stopFade(handle);
+    };
 
-                if(c->width16bit)
-                {
+    // call after changing the fixture behind DMXfixture's back,
+    // e.g. through an ofLight pointer or the temperature range members.
+    // Stops a running fade.
+    void markChanged()
+    {
+        engine->stopFade(handle);
+        syncState();
+        engine->markChanged(handle);
+    };
 
-                    unsigned int valueInt = ofMap(value, 0.,1., 0, 65025);
+    unsigned int getChangeGeneration()
+    {
+        DMXfixtureState * state = getState();
+        return state != NULL ? state->changeGeneration : 0;
+    };
 
-                    int highByte = valueInt/255;
-                    updateChannelValue(c->address, highByte);
-                    int lowByte = valueInt%255;
-                    updateChannelValue(c->address+1, highByte);
+    // NULL if the fixture's state is gone from the engine
+    DMXfixtureState * getState()
+    {
+        return engine->getFixture(handle);
+    };
 
-                }
-                else
-                {
-                    unsigned int valueInt = ofMap(value, 0.,1., c->minValue, c->maxValue);
-                    updateChannelValue(c->address, valueInt);
-                }
+    // connects the transport, once
+    static void setupOutput()
+    {
+        if(!oladSetup)
+        {
+            engine->getOutput().setup();
+            oladSetup = true;
+        }
+    };
+
+    static void update()
+    {
+        engine->update();
+        const vector<DMXhandle> & faded = engine->getFadedFixtures();
+        for(vector<DMXhandle>::const_iterator it = faded.begin(); it != faded.end(); it++)
+        {
+            DMXfixtureState * state = engine->getFixture(*it);
+            if(state != NULL && state->owner != NULL)
+            {
+                ((DMXfixture *) state->owner)->pullState();
             }
         }
+    };
 
-#ifdef USE_OLA_LIB_AND_NOT_OSC
-        if (!ola_client->SendDmx(0, *(buffer)))
+    // sends from a thread of its own at a fixed rate instead of from update()
+    static void startOutputThread(float framesPerSecond = 44)
+    {
+        engine->getOutput().startThread(framesPerSecond);
+    };
+
+    static void stopOutputThread()
+    {
+        engine->getOutput().stopThread();
+    };
+
+    // records everything the output sends, relative paths are in the data folder
+    static bool startRecording(string path)
+    {
+        engine->getOutput().setTap(NULL);
+        if(!recorder->start(ofToDataPath(path)))
         {
-            cout << "Send DMX failed" << endl;
+            return false;
         }
+        engine->getOutput().setTap(recorder);
+        return true;
+    };
+
+    static void stopRecording()
+    {
+        engine->getOutput().setTap(NULL);
+        recorder->stop();
+    };
+
+    // plays a recording in place of the fixtures until stopPlayback(),
+    // seek and loop through DMXfixture::player
+    static bool startPlayback(string path)
+    {
+        if(!player->open(ofToDataPath(path)))
+        {
+            return false;
+        }
+        player->play();
+        engine->setSource(player);
+        return true;
+    };
+
+    static void stopPlayback()
+    {
+        engine->setSource(NULL);
+        player->unlockFromClock();
+        player->close();
+    };
+
+    // runs fades, playback and output on DMXfixture::showClock instead of
+    // the steady clock; start, locate or chase() it from the app
+    static void useShowClock(bool use)
+    {
+        engine->setClock(use ? showClock : NULL);
+    };
+
+    // plays a recording locked to the show clock, its start at offsetMicros
+    static bool startTimecodePlayback(string path, unsigned long long offsetMicros = 0)
+    {
+        if(!player->open(ofToDataPath(path)))
+        {
+            return false;
+        }
+        useShowClock(true);
+        player->lockToClock(offsetMicros);
+        engine->setSource(player);
+        return true;
+    };
+
+    // sends the show clock as timecode, where the transport can
+    static void startTimecode(DMXtimecode::DMXtimecodeType type = DMXtimecode::DMX_TIMECODE_EBU)
+    {
+        useShowClock(true);
+        engine->getOutput().setTimecodeGeneration(true, type);
+    };
+
+    static void stopTimecode()
+    {
+        engine->getOutput().setTimecodeGeneration(false);
+    };
+
+    // how often an unchanged universe is resent, 0 sends every frame
+    static void setKeepAliveInterval(unsigned int millis)
+    {
+        engine->getOutput().setKeepAliveInterval(millis);
+    };
+
+    static unsigned int getKeepAliveInterval()
+    {
+        return engine->getOutput().getKeepAliveInterval();
+    };
+
+#ifdef USE_ASYNC_OUTPUT
+    // universe frames a newer frame replaced before they could be sent
+    static unsigned long long getDroppedFrames()
+    {
+        return asyncTransport->getDroppedFrames();
+    };
+#endif
+
+#if !defined(USE_OLA_LIB_AND_NOT_OSC) && !defined(USE_SACN_TRANSPORT) && !defined(USE_ARTNET_TRANSPORT)
+    static void setOscSendMode(DMXoscTransport::sendModeType m)
+    {
+        transport->setSendMode(m);
+    };
 #endif
+
+    // the fixture layer's buffer of a universe, allocated on first use
+    static DMXuniverse * getUniverse(unsigned int number)
+    {
+        return engine->getUniverse(number);
     };
 
-#ifdef USE_OLA_LIB_AND_NOT_OSC
-    static void updateChannelValue(int channel, int value)
+    // merges a layer, e.g. an operator override or a DMXplayer set as the
+    // layer's source, with the fixtures
+    static void addLayer(DMXlayer * layer)
     {
-        buffer->SetChannel(channel-1, value);
+        engine->addLayer(layer);
     };
-#else
-    static void updateChannelValue(int channel, int value)
+
+    static void removeLayer(DMXlayer * layer)
     {
-        if(buffer[channel-1] != value)
+        engine->removeLayer(layer);
+    };
+
+    static DMXlayer & getFixtureLayer()
+    {
+        return engine->getFixtureLayer();
+    };
+
+    // outputs a strip of pixels, packed and written a universe at a time
+    // rather than as a fixture per pixel; see DMXpixelStrip
+    static void addPixelStrip(DMXpixelStrip * strip)
+    {
+        setupOutput();
+        engine->addPixelStrip(strip);
+    };
+
+    static void removePixelStrip(DMXpixelStrip * strip)
+    {
+        engine->removePixelStrip(strip);
+    };
+
+    // samples e.g. a video frame or a read back ofFbo at the map's points
+    static void samplePixels(DMXpixelMap & map, const ofPixels & pixels)
+    {
+        map.sample(pixels.getPixels(), pixels.getWidth(), pixels.getHeight(), pixels.getNumChannels());
+    };
+
+    // sets fixtures[i] to the colour of point i of the map
+    static void setColors(const vector<DMXfixture*> & fixtures, const DMXpixelMap & map)
+    {
+        size_t n = std::min(fixtures.size(), map.size());
+        if(n == 0 || map.getRed() == NULL)
         {
-            ofxOscMessage m;
-            m.setAddress("/dmx/universe/0");
-            m.addIntArg(channel);
-            m.addIntArg(value);
-            oscSender->sendMessage(m);
-            buffer[channel-1] = value;
+            return;
         }
+        for(size_t i = 0; i < n; i++)
+        {
+            fixtures[i]->setDiffuseColor(ofFloatColor(map.getRed()[i], map.getGreen()[i], map.getBlue()[i]));
+        }
+    };
+
+    static void invalidatePatch()
+    {
+        engine->invalidatePatch();
     };
-#endif // USE_OLA_LIB_AND_NOT_OSC
 
     void draw()
     {
         ofPushStyle();
         ofSetColor(ofLight::getDiffuseColor());
         ofLight::draw();
-        ofDrawBitmapString(ofToString(DMXstartAddress), ofLight::getGlobalPosition());
+        string label = ofToString(getDMXstartAddress());
+        if(getDMXstartUniverse() > 0)
+        {
+            label = ofToString(getDMXstartUniverse()) + "." + label;
+        }
+        ofDrawBitmapString(label, ofLight::getGlobalPosition());
         ofPopStyle();
     }
 
@@ -248,138 +416,87 @@ public:
 
     static ofFloatColor temperatureToColor(unsigned int temp)
     {
+        float rgb[3];
+        DMXcolor::temperatureToRGB(temp, rgb);
+        return ofFloatColor(rgb[0], rgb[1], rgb[2]);
+    };
 
-        float blackbodyColor[91*3] =
-        {
-            1.0000, 0.0425, 0.0000, // 1000K
-            1.0000, 0.0668, 0.0000, // 1100K
-            1.0000, 0.0911, 0.0000, // 1200K
-            1.0000, 0.1149, 0.0000, // ...
-            1.0000, 0.1380, 0.0000,
-            1.0000, 0.1604, 0.0000,
-            1.0000, 0.1819, 0.0000,
-            1.0000, 0.2024, 0.0000,
-            1.0000, 0.2220, 0.0000,
-            1.0000, 0.2406, 0.0000,
-            1.0000, 0.2630, 0.0062,
-            1.0000, 0.2868, 0.0155,
-            1.0000, 0.3102, 0.0261,
-            1.0000, 0.3334, 0.0379,
-            1.0000, 0.3562, 0.0508,
-            1.0000, 0.3787, 0.0650,
-            1.0000, 0.4008, 0.0802,
-            1.0000, 0.4227, 0.0964,
-            1.0000, 0.4442, 0.1136,
-            1.0000, 0.4652, 0.1316,
-            1.0000, 0.4859, 0.1505,
-            1.0000, 0.5062, 0.1702,
-            1.0000, 0.5262, 0.1907,
-            1.0000, 0.5458, 0.2118,
-            1.0000, 0.5650, 0.2335,
-            1.0000, 0.5839, 0.2558,
-            1.0000, 0.6023, 0.2786,
-            1.0000, 0.6204, 0.3018,
-            1.0000, 0.6382, 0.3255,
-            1.0000, 0.6557, 0.3495,
-            1.0000, 0.6727, 0.3739,
-            1.0000, 0.6894, 0.3986,
-            1.0000, 0.7058, 0.4234,
-            1.0000, 0.7218, 0.4485,
-            1.0000, 0.7375, 0.4738,
-            1.0000, 0.7529, 0.4992,
-            1.0000, 0.7679, 0.5247,
-            1.0000, 0.7826, 0.5503,
-            1.0000, 0.7970, 0.5760,
-            1.0000, 0.8111, 0.6016,
-            1.0000, 0.8250, 0.6272,
-            1.0000, 0.8384, 0.6529,
-            1.0000, 0.8517, 0.6785,
-            1.0000, 0.8647, 0.7040,
-            1.0000, 0.8773, 0.7294,
-            1.0000, 0.8897, 0.7548,
-            1.0000, 0.9019, 0.7801,
-            1.0000, 0.9137, 0.8051,
-            1.0000, 0.9254, 0.8301,
-            1.0000, 0.9367, 0.8550,
-            1.0000, 0.9478, 0.8795,
-            1.0000, 0.9587, 0.9040,
-            1.0000, 0.9694, 0.9283,
-            1.0000, 0.9798, 0.9524,
-            1.0000, 0.9900, 0.9763,
-            1.0000, 1.0000, 1.0000, /* 6500K */
-            0.9771, 0.9867, 1.0000,
-            0.9554, 0.9740, 1.0000,
-            0.9349, 0.9618, 1.0000,
-            0.9154, 0.9500, 1.0000,
-            0.8968, 0.9389, 1.0000,
-            0.8792, 0.9282, 1.0000,
-            0.8624, 0.9179, 1.0000,
-            0.8465, 0.9080, 1.0000,
-            0.8313, 0.8986, 1.0000,
-            0.8167, 0.8895, 1.0000,
-            0.8029, 0.8808, 1.0000,
-            0.7896, 0.8724, 1.0000,
-            0.7769, 0.8643, 1.0000,
-            0.7648, 0.8565, 1.0000,
-            0.7532, 0.8490, 1.0000,
-            0.7420, 0.8418, 1.0000,
-            0.7314, 0.8348, 1.0000,
-            0.7212, 0.8281, 1.0000,
-            0.7113, 0.8216, 1.0000,
-            0.7018, 0.8153, 1.0000,
-            0.6927, 0.8092, 1.0000,
-            0.6839, 0.8032, 1.0000,
-            0.6755, 0.7975, 1.0000,
-            0.6674, 0.7921, 1.0000,
-            0.6595, 0.7867, 1.0000,
-            0.6520, 0.7816, 1.0000,
-            0.6447, 0.7765, 1.0000,
-            0.6376, 0.7717, 1.0000,
-            0.6308, 0.7670, 1.0000,
-            0.6242, 0.7623, 1.0000,
-            0.6179, 0.7579, 1.0000,
-            0.6117, 0.7536, 1.0000,
-            0.6058, 0.7493, 1.0000,
-            0.6000, 0.7453, 1.0000,
-            0.5944, 0.7414, 1.0000 /* 10000K */
-        };
-
-        float alpha = (temp % 100) / 100.0;
-        int temp_index = ((temp - 1000) / 100)*3;
-
-        ofFloatColor fromColor = ofFloatColor(blackbodyColor[temp_index], blackbodyColor[temp_index+1], blackbodyColor[temp_index+2]);
-        ofFloatColor toColor = ofFloatColor(blackbodyColor[temp_index+3], blackbodyColor[temp_index+3+1], blackbodyColor[temp_index+3+2]);
-
-        return fromColor.lerp(toColor, alpha);
+    // sets the temperature of many fixtures at once, keeping their brightness
+    static void setTemperatures(const vector<DMXfixture*> & fixtures, const vector<unsigned int> & degreesKelvin)
+    {
+        size_t n = std::min(fixtures.size(), degreesKelvin.size());
+        if(n == 0)
+        {
+            return;
+        }
+        vector<float> kelvin(degreesKelvin.begin(), degreesKelvin.begin()+n);
+        vector<float> r(n), g(n), b(n);
+        DMXcolor::temperaturesToRGB(&kelvin[0], &r[0], &g[0], &b[0], n);
+        for(size_t i = 0; i < n; i++)
+        {
+            DMXfixture * f = fixtures[i];
+            // blackbody colours peak at 1, so brightness is a plain scale
+            float brightness = f->getNormalisedBrightness();
+            ofFloatColor c = f->ofLight::getDiffuseColor();
+            f->temperature = degreesKelvin[i];
+            f->ofLight::setDiffuseColor(ofFloatColor(r[i]*brightness, g[i]*brightness, b[i]*brightness, c.a));
+            f->markChanged();
+        }
     };
 
 protected:
 
     unsigned int temperature;
 
-    static vector<DMXfixture*> * DMXfixtures;
+    DMXhandle handle;
 
-    void addMe()
+    // copies what the engine evaluates from the ofLight into the state
+    void syncState()
     {
-        DMXfixtures->push_back(this);
-    }
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return;
+        }
+        ofFloatColor c = ofLight::getDiffuseColor();
+        state->r = c.r;
+        state->g = c.g;
+        state->b = c.b;
+        state->temperature = temperature;
+        state->temperatureRangeColdKelvin = temperatureRangeColdKelvin;
+        state->temperatureRangeWarmKelvin = temperatureRangeWarmKelvin;
+    };
 
-    void removeMe()
+    // copies what a fade has done to the state back into the ofLight
+    void pullState()
     {
-        if(DMXfixtures->size() == 1){
-            DMXfixtures->clear();
-        } else {
-            for(vector<DMXfixture*>::iterator it = DMXfixtures->begin(); it != DMXfixtures->end(); ++it )
-            {
-                DMXfixture * l = *(it);
-                if(this == l)
-                {
-                    DMXfixtures->erase(it);
-                    break;
-                }
-            }
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return;
         }
-    }
+        ofFloatColor c = ofLight::getDiffuseColor();
+        ofLight::setDiffuseColor(ofFloatColor(state->r, state->g, state->b, c.a));
+        temperature = state->temperature;
+    };
+
+    // gives this fixture's state the patch and everything else of other's,
+    // the colour comes from the ofLight
+    void copyState(const DMXfixture & other)
+    {
+        DMXfixtureState * from = engine->getFixture(other.handle);
+        DMXfixtureState * to = getState();
+        if(from == NULL || to == NULL)
+        {
+            return;
+        }
+        to->x = from->x;
+        to->y = from->y;
+        to->z = from->z;
+        to->attenuation = from->attenuation;
+        engine->setProfile(handle, from->profile, from->startAddress, from->universe);
+        markChanged();
+    };
 
 };
 
@@ -397,31 +514,40 @@ public:
     };
 
     ofxOlaShaderLight()
+    {
+        setupShader();
+    };
+
+    ~ofxOlaShaderLight()
+    {
+        // this fixture is still registered until ~DMXfixture runs
+        releaseShader();
+    }
+
+    static void setupShader()
     {
         if (!shaderSetup)
         {
             shader->load("shaders/phongShading");
+            lightStructUploaded = false;
             //shader->printLayout("Material");
             //shader->printLayout("Light");
             shaderSetup = true;
         }
     };
 
-    ~ofxOlaShaderLight()
+    // called by a fixture that is about to leave the engine
+    static void releaseShader()
     {
-        if(DMXfixture::DMXfixtures->empty())
+        if(DMXfixture::engine->fixtures.size() == 1)
         {
             shaderSetup = false;
         }
-    }
+    };
 
-    void setupBrightnessDMXChannel(int startAddress)
+    void setupBrightnessDMXChannel(int startAddress, unsigned int universe = 0)
     {
-        DMXstartAddress = startAddress;
-        if(startAddress > 0)
-        {
-            DMXchannels.push_back(new DMXchannel(startAddress, DMXchannel::DMX_CHANNEL_BRIGHTNESS, false));
-        }
+        setProfile(DMXprofile::brightness(), startAddress, universe);
     }
 
     struct Material
@@ -498,6 +624,8 @@ public:
 protected:
 
     static Light lightStruct;
+    static Light uploadedLightStruct;
+    static bool lightStructUploaded;
 
     static void updateShaderLightStruct()
     {
@@ -508,18 +636,29 @@ protected:
         //TODO: use cc
 
         lightStruct.ambientIntensity = ofVec4f(0.0,0.0,0.0,1.0);
-        lightStruct.numberLights = DMXfixtures->size();
         int lightIndex = 0;
-        for(vector<DMXfixture*>::iterator it = DMXfixtures->begin(); it != DMXfixtures->end(); ++it )
+        ofMatrix4x4 modelView = ofGetCurrentMatrix(OF_MATRIX_MODELVIEW);
+        for(unsigned int i = 0; i < engine->fixtures.size(); i++)
         {
-            DMXfixture * l = *(it);
             if(lightIndex < MAX_SHADER_LIGHTS)
             {
-                ofFloatColor c = l->getDiffuseColor();
-                lightStruct.lights[lightIndex].lightIntensity = ofVec4f(c[0],c[1],c[2],c[3]);
-                lightStruct.lights[lightIndex].lightAttenuation = l->getAttenuationConstant();
-                ofVec3f lightCamSpacePos = l->getPosition() * ofGetCurrentMatrix(OF_MATRIX_MODELVIEW);
-                lightStruct.lights[lightIndex].cameraSpaceLightPos = lightCamSpacePos;
+                const DMXfixtureState & f = engine->fixtures[i];
+                PerLight & light = lightStruct.lights[lightIndex];
+                DMXfixture * l = (DMXfixture *) f.owner;
+                if(l != NULL)
+                {
+                    // an ofLight can be moved or recoloured without telling its fixture
+                    ofFloatColor c = l->getDiffuseColor();
+                    light.lightIntensity = ofVec4f(c[0],c[1],c[2],c[3]);
+                    light.lightAttenuation = l->getAttenuationConstant();
+                    light.cameraSpaceLightPos = l->getPosition() * modelView;
+                }
+                else
+                {
+                    light.lightIntensity = ofVec4f(f.r,f.g,f.b,1.);
+                    light.lightAttenuation = f.attenuation;
+                    light.cameraSpaceLightPos = ofVec3f(f.x,f.y,f.z) * modelView;
+                }
             }
             else
             {
@@ -527,6 +666,7 @@ protected:
             }
             lightIndex++;
         }
+        lightStruct.numberLights = std::min(lightIndex, MAX_SHADER_LIGHTS);
     };
 
     static void updateShader()
@@ -534,7 +674,16 @@ protected:
         if (shaderSetup)
         {
             updateShaderLightStruct();
-            shader->setUniformBuffer("Light", lightStruct);
+
+            // camera space positions follow the modelview matrix, so compare
+            // the finished struct rather than the fixture generations
+
+            if(!lightStructUploaded || memcmp(&lightStruct, &uploadedLightStruct, sizeof(Light)) != 0)
+            {
+                shader->setUniformBuffer("Light", lightStruct);
+                memcpy(&uploadedLightStruct, &lightStruct, sizeof(Light));
+                lightStructUploaded = true;
+            }
 
             switch (shading) {
                 case OFX_OLA_SHADER_LIGHT_FLAT:
@@ -560,3 +709,267 @@ protected:
     static shadingType shading;
 
 };
+
+// A fixture without an ofLight. Everything it has lives in its
+// DMXfixtureState, so it takes no ofNode, no GL light and no slot in
+// openFrameworks' light list. It is lit by the ofxOlaShaderLight shader
+// like any other fixture.
+
+class DMXlight
+{
+public:
+
+    DMXlight()
+    {
+        DMXfixture::setupOutput();
+        ofxOlaShaderLight::setupShader();
+        handle = DMXfixture::engine->addFixture();
+    };
+
+    ~DMXlight()
+    {
+        ofxOlaShaderLight::releaseShader();
+        DMXfixture::engine->removeFixture(handle);
+    };
+
+    void setProfile(const DMXprofile * profile, int startAddress, unsigned int universe = 0)
+    {
+        DMXfixture::engine->setProfile(handle, profile, startAddress, universe);
+    };
+
+    const DMXprofile * getProfile()
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return NULL;
+        }
+        return state->profile;
+    };
+
+    int getDMXstartAddress()
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return 0;
+        }
+        return state->startAddress;
+    };
+
+    unsigned int getDMXstartUniverse()
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return 0;
+        }
+        return state->universe;
+    };
+
+    void setPosition(float x, float y, float z)
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return;
+        }
+        state->x = x;
+        state->y = y;
+        state->z = z;
+    };
+
+    void setPosition(const ofVec3f & p)
+    {
+        setPosition(p.x, p.y, p.z);
+    };
+
+    ofVec3f getPosition()
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return ofVec3f();
+        }
+        return ofVec3f(state->x, state->y, state->z);
+    };
+
+    void setAttenuation(float constant)
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return;
+        }
+        state->attenuation = constant;
+    };
+
+    float getAttenuationConstant()
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return 1.;
+        }
+        return state->attenuation;
+    };
+
+    void setDiffuseColor(const ofFloatColor & c)
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return;
+        }
+        state->r = c.r;
+        state->g = c.g;
+        state->b = c.b;
+        markChanged();
+    };
+
+    ofFloatColor getDiffuseColor()
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return ofFloatColor(0., 0., 0.);
+        }
+        return ofFloatColor(state->r, state->g, state->b);
+    };
+
+    void setNormalisedBrightness(float brightness)
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return;
+        }
+        DMXcolor::setBrightness(state->r, state->g, state->b, brightness);
+        markChanged();
+    };
+
+    float getNormalisedBrightness()
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return 0.;
+        }
+        return std::max(state->r, std::max(state->g, state->b));
+    };
+
+    void setTemperature(unsigned int degreesKelvin)
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return;
+        }
+        // blackbody colours peak at 1, so brightness is a plain scale
+        float brightness = getNormalisedBrightness();
+        float rgb[3];
+        DMXcolor::temperatureToRGB(degreesKelvin, rgb);
+        state->r = rgb[0] * brightness;
+        state->g = rgb[1] * brightness;
+        state->b = rgb[2] * brightness;
+        state->temperature = degreesKelvin;
+        markChanged();
+    };
+
+    unsigned int getTemperature()
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return 0;
+        }
+        return state->temperature;
+    };
+
+    void setTemperatureRange(unsigned int coldKelvin, unsigned int warmKelvin)
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return;
+        }
+        state->temperatureRangeColdKelvin = coldKelvin;
+        state->temperatureRangeWarmKelvin = warmKelvin;
+        markChanged();
+    };
+
+    void fadeToColor(const ofFloatColor & c, float seconds, const DMXcurve * curve = NULL)
+    {
+        DMXfixture::engine->fadeTo(handle, c.r, c.g, c.b, getTemperature(), seconds, curve);
+    };
+
+    void fadeToBrightness(float brightness, float seconds, const DMXcurve * curve = NULL)
+    {
+        DMXfixtureState * state = getState();
+        if(state == NULL)
+        {
+            return;
+        }
+        float r = state->r, g = state->g, b = state->b;
+        DMXcolor::setBrightness(r, g, b, brightness);
+        DMXfixture::engine->fadeTo(handle, r, g, b, state->temperature, seconds, curve);
+    };
+
+    void fadeToTemperature(unsigned int degreesKelvin, float seconds, const DMXcurve * curve = NULL)
+    {
+        float brightness = getNormalisedBrightness();
+        float rgb[3];
+        DMXcolor::temperatureToRGB(degreesKelvin, rgb);
+        DMXfixture::engine->fadeTo(handle, rgb[0] * brightness, rgb[1] * brightness, rgb[2] * brightness, degreesKelvin, seconds, curve);
+    };
+
+    bool isFading()
+    {
+        return DMXfixture::engine->isFading(handle);
+    };
+
+    void stopFade()
+    {
+        DMXfixture::engine->stopFade(handle);
+    };
+
+    // call after changing the state directly, stops a running fade
+    void markChanged()
+    {
+        DMXfixture::engine->stopFade(handle);
+        DMXfixture::engine->markChanged(handle);
+    };
+
+    DMXfixtureState * getState()
+    {
+        return DMXfixture::engine->getFixture(handle);
+    };
+
+    DMXhandle getHandle()
+    {
+        return handle;
+    };
+
+    void draw()
+    {
+        ofPushStyle();
+        ofSetColor(getDiffuseColor());
+        ofDrawSphere(getPosition(), 10);
+        string label = ofToString(getDMXstartAddress());
+        if(getDMXstartUniverse() > 0)
+        {
+            label = ofToString(getDMXstartUniverse()) + "." + label;
+        }
+        ofDrawBitmapString(label, getPosition());
+        ofPopStyle();
+    }
+
+private:
+
+    // owns its engine registration
+    DMXlight(const DMXlight &);
+    DMXlight & operator=(const DMXlight &);
+
+    DMXhandle handle;
+
+};